@@ -0,0 +1,392 @@
+//
+//  mstrie_c.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <new>
+#include <string>
+#include <vector>
+#include "mstrie_c.h"
+#include "../core/index_manager.hpp"
+#include "../lib/configurator.hpp"
+
+
+struct mstrie {
+	std::unique_ptr<MstrieStructure> structure;
+	// reused by the queries of the handle
+	std::vector<uint> input;
+};
+
+struct mstrie_manager {
+	std::unique_ptr<Configurator> config;
+	std::unique_ptr<MstrieManager> manager;
+	// reused by the queries of the handle
+	std::vector<uint> input;
+	std::vector<std::pair<std::string, std::string>> updates;
+	std::vector<std::string> errors;
+};
+
+namespace {
+
+thread_local std::string last_error;
+
+/* Runs the body and turns an exception into the status of a C function */
+template <typename Body>
+mstrie_status guard(Body body) {
+	try {
+		last_error.clear();
+		body();
+		return MSTRIE_OK;
+	} catch (std::bad_alloc &e) {
+		last_error = "out of memory";
+		return MSTRIE_NO_MEMORY;
+	} catch (std::exception &e) {
+		last_error = e.what();
+		return MSTRIE_ERROR;
+	} catch (...) {
+		last_error = "unknown error";
+		return MSTRIE_ERROR;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status invalid(const char *message) {
+	last_error = message;
+	return MSTRIE_INVALID_ARGUMENT;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+const char* query_type(mstrie_query query) {
+	switch (query) {
+		case MSTRIE_EXACT: return "=";
+		case MSTRIE_SUBSET: return "<=";
+		case MSTRIE_SUPERSET: return ">=";
+	}
+	return nullptr;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// multiplicity vector in the element:multiplicity notation, which the managers always accept
+void vector_to_word(const uint32_t *v, uint alphabet, std::string &word) {
+	word.clear();
+	for (uint ch = 0; ch < alphabet; ch++) {
+		if (v[ch] == 0) continue;
+		if (!word.empty()) word += ',';
+		word += std::to_string(ch);
+		word += ':';
+		word += std::to_string(v[ch]);
+	}
+	if (word.empty()) word = "*";
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// the limit of the structure, which caps it at the highest multiplicity itself
+uint structure_limit(int32_t limit) {
+	return limit < 0 ? static_cast<uint>(-1) : static_cast<uint>(limit);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+// the bound of the structure for a cardinality bound of the interface
+uint structure_cardinality(int32_t max_cardinality) {
+	return max_cardinality < 0 ? static_cast<uint>(-1) : static_cast<uint>(max_cardinality);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+/* Calls the callback for every multiset found during the traversal until it returns nonzero */
+class CallbackVisitor : public MstrieVisitor {
+private:
+	mstrie_retrieve_callback callback;
+	void *context;
+public:
+	CallbackVisitor(mstrie_retrieve_callback callback, void *context)
+	: callback(callback), context(context) { }
+	
+	bool visit(const uint *multiplicities) override {
+		static_assert(sizeof(uint) == sizeof(uint32_t), "multiplicities are passed without a copy");
+		return callback(reinterpret_cast<const uint32_t*>(multiplicities), context) == 0;
+	}
+};
+
+} // namespace
+
+// ===============================================================================================
+// ===============================================================================================
+
+const char *mstrie_last_error(void) {
+	return last_error.c_str();
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+/* ------------------------------------------------------------------
+ * Multiset-trie in memory
+ * ------------------------------------------------------------------
+ */
+mstrie_status mstrie_create(uint32_t alphabet_length, uint32_t max_multiplicity, mstrie **out) {
+	if (out == nullptr) return invalid("out is null");
+	if (alphabet_length == 0) return invalid("alphabet length must be positive");
+	*out = nullptr;
+	return guard([&]() {
+		auto handle = std::make_unique<mstrie>();
+		// the statistics of the last query are not exposed through the C interface
+		handle->structure = std::make_unique<MstrieStructure>(MstrieSettings(alphabet_length, max_multiplicity, "", false, false, MstrieStatsLevel::none));
+		handle->input.resize(alphabet_length);
+		*out = handle.release();
+	});
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void mstrie_destroy(mstrie *handle) {
+	delete handle;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint32_t mstrie_alphabet_length(const mstrie *handle) {
+	return handle == nullptr ? 0 : handle->structure->alphabet();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_insert(mstrie *handle, const uint32_t *multiplicities) {
+	return mstrie_insert_batch(handle, multiplicities, 1);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_delete(mstrie *handle, const uint32_t *multiplicities) {
+	if (handle == nullptr || multiplicities == nullptr) return invalid("handle or multiplicities is null");
+	return guard([&]() {
+		handle->input.assign(multiplicities, multiplicities + handle->input.size());
+		handle->structure->pub_mstrie_delete(handle->input);
+	});
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_insert_batch(mstrie *handle, const uint32_t *multiplicities, size_t count) {
+	if (handle == nullptr || (multiplicities == nullptr && count > 0)) return invalid("handle or multiplicities is null");
+	return guard([&]() {
+		size_t alphabet = handle->input.size();
+		for (size_t i = 0; i < count; i++) {
+			handle->input.assign(multiplicities + i * alphabet, multiplicities + (i + 1) * alphabet);
+			handle->structure->pub_mstrie_insert(handle->input);
+		}
+	});
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_search(mstrie *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit, int *found) {
+	if (found == nullptr) return invalid("found is null");
+	uint8_t result = 0;
+	mstrie_status status = mstrie_search_batch(handle, query, multiplicities, 1, limit, &result);
+	*found = result;
+	return status;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_search_batch(mstrie *handle, mstrie_query query, const uint32_t *multiplicities, size_t count, int32_t limit, uint8_t *found) {
+	if (handle == nullptr || ((multiplicities == nullptr || found == nullptr) && count > 0)) return invalid("handle, multiplicities or found is null");
+	if (query_type(query) == nullptr) return invalid("unknown query");
+	return guard([&]() {
+		size_t alphabet = handle->input.size();
+		auto &structure = *handle->structure;
+		for (size_t i = 0; i < count; i++) {
+			handle->input.assign(multiplicities + i * alphabet, multiplicities + (i + 1) * alphabet);
+			bool result;
+			if (query == MSTRIE_EXACT)
+				result = structure.pub_mstrie_search(handle->input);
+			else if (query == MSTRIE_SUBSET)
+				result = structure.pub_mstrie_subseteq(handle->input, structure_limit(limit));
+			else
+				result = structure.pub_mstrie_superseteq(handle->input, structure_limit(limit));
+			found[i] = result ? 1 : 0;
+		}
+	});
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_retrieve(mstrie *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit,
+	mstrie_retrieve_callback callback, void *context) {
+	if (handle == nullptr || multiplicities == nullptr || callback == nullptr) return invalid("handle, multiplicities or callback is null");
+	if (query_type(query) == nullptr) return invalid("unknown query");
+	return guard([&]() {
+		auto &structure = *handle->structure;
+		CallbackVisitor visitor(callback, context);
+		handle->input.assign(multiplicities, multiplicities + handle->input.size());
+		if (query == MSTRIE_EXACT) {
+			if (structure.pub_mstrie_search(handle->input))
+				visitor.visit(handle->input.data());
+		}
+		else if (query == MSTRIE_SUBSET)
+			structure.pub_mstrie_get_subseteq(handle->input, structure_limit(limit), visitor);
+		else
+			structure.pub_mstrie_get_superseteq(handle->input, structure_limit(limit), visitor);
+	});
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_retrieve_bounded(mstrie *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit,
+	uint32_t min_cardinality, int32_t max_cardinality, mstrie_retrieve_callback callback, void *context) {
+	if (handle == nullptr || multiplicities == nullptr || callback == nullptr) return invalid("handle, multiplicities or callback is null");
+	if (query_type(query) == nullptr) return invalid("unknown query");
+	return guard([&]() {
+		auto &structure = *handle->structure;
+		CallbackVisitor visitor(callback, context);
+		uint max_bound = structure_cardinality(max_cardinality);
+		handle->input.assign(multiplicities, multiplicities + handle->input.size());
+		if (query == MSTRIE_EXACT) {
+			uint cardinality = 0;
+			for (auto multiplicity : handle->input) cardinality += multiplicity;
+			if (cardinality >= min_cardinality && cardinality <= max_bound && structure.pub_mstrie_search(handle->input))
+				visitor.visit(handle->input.data());
+		}
+		else if (query == MSTRIE_SUBSET)
+			structure.pub_mstrie_get_subseteq(handle->input, structure_limit(limit), min_cardinality, max_bound, visitor);
+		else
+			structure.pub_mstrie_get_superseteq(handle->input, structure_limit(limit), min_cardinality, max_bound, visitor);
+	});
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+/* ------------------------------------------------------------------
+ * Multiset-trie of a configuration file
+ * ------------------------------------------------------------------
+ */
+mstrie_status mstrie_manager_open(const char *config_file, const char *mstrie_name, mstrie_manager **out) {
+	if (config_file == nullptr || mstrie_name == nullptr || out == nullptr) return invalid("config_file, mstrie_name or out is null");
+	*out = nullptr;
+	return guard([&]() {
+		auto handle = std::make_unique<mstrie_manager>();
+		handle->config = std::make_unique<Configurator>(config_file);
+		handle->manager = MstrieManager::from_config(*handle->config, mstrie_name);
+		handle->manager->init_index();
+		handle->input.resize(handle->manager->alphabet());
+		*out = handle.release();
+	});
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_manager_close(mstrie_manager *handle) {
+	if (handle == nullptr) return MSTRIE_OK;
+	mstrie_status status = guard([&]() {
+		handle->manager->flush_index(true);
+	});
+	delete handle;
+	return status;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_manager_save(mstrie_manager *handle) {
+	if (handle == nullptr) return invalid("handle is null");
+	return guard([&]() {
+		handle->manager->flush_index(false);
+	});
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint32_t mstrie_manager_alphabet_length(const mstrie_manager *handle) {
+	return handle == nullptr ? 0 : handle->manager->alphabet();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_manager_update(mstrie_manager *handle, int insert, const uint32_t *multiplicities) {
+	return mstrie_manager_update_batch(handle, insert, multiplicities, 1, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_manager_update_batch(mstrie_manager *handle, int insert, const uint32_t *multiplicities, size_t count, uint8_t *failed) {
+	if (handle == nullptr || (multiplicities == nullptr && count > 0)) return invalid("handle or multiplicities is null");
+	size_t failures = 0;
+	size_t first_failure = 0;
+	mstrie_status status = guard([&]() {
+		uint alphabet = handle->manager->alphabet();
+		// the updates go through the manager as words, so they are written to its log
+		handle->updates.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			handle->updates[i].first = insert ? "+" : "-";
+			vector_to_word(multiplicities + i * alphabet, alphabet, handle->updates[i].second);
+		}
+		// the updates that succeed are committed to the log together
+		handle->manager->update_batch(handle->updates, handle->errors);
+		for (size_t i = 0; i < count; i++) {
+			bool error = !handle->errors[i].empty();
+			if (failed != nullptr) failed[i] = error ? 1 : 0;
+			if (error && failures++ == 0) first_failure = i;
+		}
+	});
+	if (status != MSTRIE_OK || failures == 0) return status;
+	last_error = std::to_string(failures) + " of " + std::to_string(count) + " updates failed, update " + std::to_string(first_failure) + ": " + handle->errors[first_failure];
+	return MSTRIE_ERROR;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_manager_search(mstrie_manager *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit, int *found) {
+	if (found == nullptr) return invalid("found is null");
+	uint8_t result = 0;
+	mstrie_status status = mstrie_manager_search_batch(handle, query, multiplicities, 1, limit, &result);
+	*found = result;
+	return status;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_manager_search_batch(mstrie_manager *handle, mstrie_query query, const uint32_t *multiplicities, size_t count, int32_t limit, uint8_t *found) {
+	if (handle == nullptr || ((multiplicities == nullptr || found == nullptr) && count > 0)) return invalid("handle, multiplicities or found is null");
+	if (query_type(query) == nullptr) return invalid("unknown query");
+	return guard([&]() {
+		size_t alphabet = handle->input.size();
+		for (size_t i = 0; i < count; i++) {
+			handle->input.assign(multiplicities + i * alphabet, multiplicities + (i + 1) * alphabet);
+			found[i] = handle->manager->search_query(query_type(query), handle->input, limit) ? 1 : 0;
+		}
+	});
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_manager_retrieve(mstrie_manager *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit,
+	mstrie_retrieve_callback callback, void *context) {
+	if (handle == nullptr || multiplicities == nullptr || callback == nullptr) return invalid("handle, multiplicities or callback is null");
+	if (query_type(query) == nullptr) return invalid("unknown query");
+	return guard([&]() {
+		CallbackVisitor visitor(callback, context);
+		handle->input.assign(multiplicities, multiplicities + handle->input.size());
+		handle->manager->retrieve_query(query_type(query), handle->input, limit, 0, MSTRIE_NO_CARDINALITY, visitor);
+	});
+}
+
+// -----------------------------------------------------------------------------------------------
+
+mstrie_status mstrie_manager_retrieve_bounded(mstrie_manager *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit,
+	uint32_t min_cardinality, int32_t max_cardinality, mstrie_retrieve_callback callback, void *context) {
+	if (handle == nullptr || multiplicities == nullptr || callback == nullptr) return invalid("handle, multiplicities or callback is null");
+	if (query_type(query) == nullptr) return invalid("unknown query");
+	return guard([&]() {
+		CallbackVisitor visitor(callback, context);
+		handle->input.assign(multiplicities, multiplicities + handle->input.size());
+		handle->manager->retrieve_query(query_type(query), handle->input, limit, min_cardinality, max_cardinality, visitor);
+	});
+}
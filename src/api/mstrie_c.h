@@ -0,0 +1,107 @@
+/*
+ *  mstrie_c.h
+ *  mstrie
+ *
+ *  Copyright © 2018 Mikita Akulich. All rights reserved.
+ */
+
+#ifndef MSTRIE_C_H
+#define MSTRIE_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define MSTRIE_API __attribute__((visibility("default")))
+#else
+#define MSTRIE_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* C interface of libmstrie
+ *
+ * A multiset is passed as its multiplicity vector: alphabet_length values,
+ * the i-th one the multiplicity of element i. A batch is count vectors
+ * one after another. The functions return MSTRIE_OK or an error status,
+ * mstrie_last_error() then describes the error of the calling thread.
+ * Handles are not synchronized, a handle is used by one thread at a time.
+ */
+
+typedef struct mstrie mstrie;
+typedef struct mstrie_manager mstrie_manager;
+
+typedef enum {
+	MSTRIE_OK = 0,
+	MSTRIE_ERROR = 1,
+	MSTRIE_INVALID_ARGUMENT = 2,
+	MSTRIE_NO_MEMORY = 3
+} mstrie_status;
+
+typedef enum {
+	MSTRIE_EXACT = 1,
+	MSTRIE_SUBSET = 2,
+	MSTRIE_SUPERSET = 3
+} mstrie_query;
+
+/* limit of the multiplicities in the searched sub/supersets, -1 - none */
+#define MSTRIE_NO_LIMIT (-1)
+
+/* bound of the cardinality of the retrieved multisets, -1 - none */
+#define MSTRIE_NO_CARDINALITY (-1)
+
+/* called for every retrieved multiset as soon as the traversal finds it, a nonzero
+ * return stops the traversal; the vector is valid only during the call and the
+ * callback must not use the handle of the retrieval
+ */
+typedef int (*mstrie_retrieve_callback)(const uint32_t *multiplicities, void *context);
+
+/* message of the last error of the calling thread, empty if none */
+MSTRIE_API const char *mstrie_last_error(void);
+
+/* Multiset-trie in memory */
+MSTRIE_API mstrie_status mstrie_create(uint32_t alphabet_length, uint32_t max_multiplicity, mstrie **out);
+MSTRIE_API void mstrie_destroy(mstrie *handle);
+MSTRIE_API uint32_t mstrie_alphabet_length(const mstrie *handle);
+MSTRIE_API mstrie_status mstrie_insert(mstrie *handle, const uint32_t *multiplicities);
+MSTRIE_API mstrie_status mstrie_delete(mstrie *handle, const uint32_t *multiplicities);
+MSTRIE_API mstrie_status mstrie_insert_batch(mstrie *handle, const uint32_t *multiplicities, size_t count);
+/* found is 1 if a multiset in relation query to the given one is stored, 0 otherwise */
+MSTRIE_API mstrie_status mstrie_search(mstrie *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit, int *found);
+/* found has count entries */
+MSTRIE_API mstrie_status mstrie_search_batch(mstrie *handle, mstrie_query query, const uint32_t *multiplicities, size_t count, int32_t limit, uint8_t *found);
+MSTRIE_API mstrie_status mstrie_retrieve(mstrie *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit,
+	mstrie_retrieve_callback callback, void *context);
+/* retrieves only the multisets with at least min_cardinality and at most max_cardinality elements */
+MSTRIE_API mstrie_status mstrie_retrieve_bounded(mstrie *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit,
+	uint32_t min_cardinality, int32_t max_cardinality, mstrie_retrieve_callback callback, void *context);
+
+/* Multiset-trie of a configuration file, loaded from and saved to its index
+ * file, with the write-ahead log and checkpoints of the configuration
+ */
+MSTRIE_API mstrie_status mstrie_manager_open(const char *config_file, const char *mstrie_name, mstrie_manager **out);
+/* saves the index */
+MSTRIE_API mstrie_status mstrie_manager_close(mstrie_manager *handle);
+MSTRIE_API mstrie_status mstrie_manager_save(mstrie_manager *handle);
+MSTRIE_API uint32_t mstrie_manager_alphabet_length(const mstrie_manager *handle);
+/* insert is nonzero to insert the multisets, zero to delete them */
+MSTRIE_API mstrie_status mstrie_manager_update(mstrie_manager *handle, int insert, const uint32_t *multiplicities);
+/* every update is attempted and those that succeed are committed to the log together;
+ * if some fail, MSTRIE_ERROR is returned and failed, if not null, has 1 for them
+ * and 0 for the others in its count entries
+ */
+MSTRIE_API mstrie_status mstrie_manager_update_batch(mstrie_manager *handle, int insert, const uint32_t *multiplicities, size_t count, uint8_t *failed);
+MSTRIE_API mstrie_status mstrie_manager_search(mstrie_manager *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit, int *found);
+MSTRIE_API mstrie_status mstrie_manager_search_batch(mstrie_manager *handle, mstrie_query query, const uint32_t *multiplicities, size_t count, int32_t limit, uint8_t *found);
+MSTRIE_API mstrie_status mstrie_manager_retrieve(mstrie_manager *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit,
+	mstrie_retrieve_callback callback, void *context);
+MSTRIE_API mstrie_status mstrie_manager_retrieve_bounded(mstrie_manager *handle, mstrie_query query, const uint32_t *multiplicities, int32_t limit,
+	uint32_t min_cardinality, int32_t max_cardinality, mstrie_retrieve_callback callback, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSTRIE_C_H */
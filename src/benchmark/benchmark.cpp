@@ -6,21 +6,32 @@
 //  Copyright © 2018 Mikita Akulich. All rights reserved.
 //
 
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
 #include <iostream>
 #include <fstream>
 #include <istream>
+#include <mutex>
 #include <ostream>
+#include <queue>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
 #include "benchmark.hpp"
+#include "workload_generator.hpp"
+#include "../core/query_trace.hpp"
+#include "../utils/file_utils.hpp"
 
 Benchmark::Benchmark(const Configurator &config) {
 	this->config = std::make_unique<Configurator>(config);
 	auto mstrie = this->config->get_value<std::string>("benchmark:mstrie_name");
-	MstrieSettings settings = MstrieSettings(
-																					 this->config->get_value<uint>(mstrie + ":alphabet_length"),
-																					 this->config->get_value<uint>(mstrie + ":max_multiplicity"),
-																					 this->config->get_value<std::string>(mstrie + ":mstrie_path")
-																					 );
-	this->manager = std::make_unique<MstrieManager>(settings);
+	this->manager = MstrieManager::from_config(*this->config, mstrie);
+	this->measured_time = 0;
+	this->sample_interval = 0;
+	this->measured_operations = 0;
+	this->open_loop_rate = 0;
+	this->open_loop_workers = 1;
 }
 
 void Benchmark::run() {
@@ -40,23 +51,80 @@ void Benchmark::run() {
 	else if (search_type.compare("superset_search") == 0) {
 		mstrie_query_type = ">=";
 	}
-	else{
+	else if (search_type.compare("mixed") != 0) {
 		throw std::runtime_error("Unknown benchmark type: "+ search_type);
 	}
+	bool mixed = search_type.compare("mixed") == 0;
+	uint warmup = config->get_value<uint>("benchmark:run:warmup", 0);
+	uint repetitions = config->get_value<uint>("benchmark:run:repetitions", 1);
 	
-	/* open test and result files */
+	if (config->get_value<uint>("benchmark:run:perf_counters", 0) != 0) {
+		perf_counters = std::make_unique<PerfCounters>();
+		if (!perf_counters->available()) {
+			std::cout<<"Hardware counters are not available ("<<perf_counters->unavailable_reason()<<"), they are not reported."<<std::endl;
+			perf_counters = nullptr;
+		}
+	}
 	
-	std::ifstream test_file;
-	std::string test_file_name = config->get_value<std::string>("benchmark:run:test_file");
-	/* Setting exceptions for a file to be thrown */
-	test_file.exceptions( std::ifstream::badbit );
-	/* Open the file */
-	test_file.open(test_file_name);
-	if (!test_file.is_open()) {
-		throw std::runtime_error("ERROR: File "+ test_file_name +" can't be opened.");
+	open_loop_rate = config->get_value<double>("benchmark:open_loop:rate", 0);
+	if (open_loop_rate > 0) {
+		open_loop_arrival = config->get_value<std::string>("benchmark:open_loop:arrival", "constant");
+		open_loop_workers = std::max(1u, config->get_value<uint>("benchmark:open_loop:workers", 1));
+		arrival_rng.seed(config->get_value<unsigned long long>("benchmark:open_loop:seed", 1));
+		if (open_loop_arrival.compare("constant") != 0 && open_loop_arrival.compare("poisson") != 0) {
+			throw std::runtime_error("Unknown arrival process: "+ open_loop_arrival);
+		}
+		if (mixed) {
+			throw std::runtime_error("Open loop is not supported for the mixed benchmark.");
+		}
+		if (perf_counters != nullptr) {
+			std::cout<<"Hardware counters are not reported in open loop, the queries run on worker threads."<<std::endl;
+			perf_counters = nullptr;
+		}
+	}
+	
+	// the tests are read once for all repetitions
+	std::vector<std::string> tests;
+	if (mixed) {
+		populate_mixed_workload();
+	}
+	else {
+		std::string test_file_name = config->get_value<std::string>("benchmark:run:test_file");
+		if (config->get_value<uint>("benchmark:generator:enabled", 0) != 0) {
+			generate_workload(search_type, test_file_name);
+		}
+		
+		/* read test file */
+		
+		std::ifstream test_file;
+		/* Setting exceptions for a file to be thrown */
+		test_file.exceptions( std::ifstream::badbit );
+		/* Open the file */
+		test_file.open(test_file_name);
+		if (!test_file.is_open()) {
+			throw std::runtime_error("ERROR: File "+ test_file_name +" can't be opened.");
+		}
+		std::string test;
+		while (std::getline(test_file, test)) {
+			tests.push_back(test);
+		}
+		test_file.close();
+	}
+	
+	// the measured passes are traced if a trace file is given
+	std::string trace_file_name = config->get_value<std::string>("benchmark:run:trace_file", "");
+	auto trace_capacity = config->get_value<unsigned long long>("benchmark:run:trace_capacity", QueryTrace::default_capacity);
+	if (trace_capacity == 0) {
+		throw std::runtime_error("Trace capacity must be positive.");
 	}
+	
+	/* open result file */
+	
 	std::ofstream result_file;
 	std::string result_file_name = config->get_value<std::string>("benchmark:run:result_file");
+	// the results are written in large blocks
+	std::vector<char> result_buffer(1 << 20);
+	result_file.rdbuf()->pubsetbuf(result_buffer.data(), result_buffer.size());
 	/* Setting exceptions for a file to be thrown */
 	result_file.exceptions( std::ofstream::badbit | std::ofstream::failbit );
 	/* Open the file */
@@ -65,23 +133,509 @@ void Benchmark::run() {
 		throw std::runtime_error("ERROR: File "+result_file_name+" can't be opened.");
 	}
 	
-	process(mstrie_query_type, test_file, result_file);
+	if (mixed) {
+		auto operations = config->get_value<unsigned long long>("benchmark:mixed:operations");
+		sample_interval = std::max(1ULL, config->get_value<unsigned long long>("benchmark:mixed:sample_interval", 1000));
+		std::ofstream timeline_file;
+		std::string timeline_file_name = config->get_value<std::string>("benchmark:mixed:timeline_file", result_file_name + ".timeline.csv");
+		timeline_file.exceptions( std::ofstream::badbit | std::ofstream::failbit );
+		timeline_file.open(timeline_file_name);
+		if (!timeline_file.is_open()) {
+			throw std::runtime_error("ERROR: File "+timeline_file_name+" can't be opened.");
+		}
+		
+		// result file header
+		result_file<<"operation;test;output;time_μs\n";
+		timeline_file<<"operations;time_ms;nodes;multisets;resident_bytes\n";
+		for (uint i = 0; i < warmup; i++) {
+			process_mixed(operations, nullptr, nullptr);
+		}
+		latencies.clear();
+		profiles.clear();
+		counter_values.clear();
+		traversed_nodes.clear();
+		measured_time = 0;
+		measured_operations = 0;
+		tp_measured_start = std::chrono::steady_clock::now();
+		write_sample(timeline_file);
+		if (!trace_file_name.empty()) QueryTrace::start(trace_capacity);
+		for (uint i = 0; i < repetitions; i++) {
+			process_mixed(operations, &result_file, &timeline_file);
+		}
+		timeline_file.close();
+	}
+	else {
+		// result file header
+		result_file<<"test;output;time_μs\n";
+		auto pass = open_loop_rate > 0 ? &Benchmark::process_open_loop : &Benchmark::process;
+		for (uint i = 0; i < warmup; i++) {
+			(this->*pass)(search_type, mstrie_query_type, tests, nullptr);
+		}
+		latencies.clear();
+		profiles.clear();
+		counter_values.clear();
+		traversed_nodes.clear();
+		service_latencies.clear();
+		measured_time = 0;
+		if (!trace_file_name.empty()) QueryTrace::start(trace_capacity);
+		for (uint i = 0; i < repetitions; i++) {
+			(this->*pass)(search_type, mstrie_query_type, tests, &result_file);
+		}
+	}
+	
+	result_file.close();
+	
+	if (!trace_file_name.empty()) {
+		QueryTrace::stop();
+		FileUtils::write_file(trace_file_name, QueryTrace::export_json());
+	}
+	
+	/* write summary next to result file */
+	std::string summary_format = config->get_value<std::string>("benchmark:run:summary_format", "json");
+	if (summary_format.compare("json") != 0 && summary_format.compare("csv") != 0) {
+		throw std::runtime_error("Unknown benchmark summary format: "+ summary_format);
+	}
+	write_summary(config->get_value<std::string>("benchmark:run:summary_file", result_file_name + ".summary." + summary_format), summary_format);
+}
+
+
+void Benchmark::process(const std::string &search_type, const std::string &mstrie_query_type, const std::vector<std::string> &tests, std::ofstream *ofile) {
+	LatencyHistogram &histogram = latencies[search_type];
+	auto tp_run_start = std::chrono::steady_clock::now();
+	for (auto &test : tests) {
+		TraceSpan span("query");
+		if (perf_counters != nullptr) perf_counters->start();
+		auto tp_start = std::chrono::steady_clock::now();
+		auto result = manager->retrieve_query(mstrie_query_type, test);
+		auto tp_end = std::chrono::steady_clock::now();
+		if (perf_counters != nullptr) perf_counters->stop();
+		if (ofile == nullptr) continue;
+		
+		uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(tp_end - tp_start).count();
+		histogram.record(latency);
+		traversed_nodes[search_type] += manager->last_query_traversed_nodes();
+#ifdef MSTRIE_PROFILE
+		profiles[search_type].merge(manager->last_query_profile());
+#endif
+		TraceSpan io_span("io");
+		*ofile<<test<<";"<<result<<";"<<latency / 1000<<"µs\n";
+	}
+	if (ofile != nullptr) {
+		measured_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - tp_run_start).count();
+	}
+	if (perf_counters != nullptr) {
+		// the counts of a warmup pass are read and dropped
+		std::vector<uint64_t> warmup_values;
+		perf_counters->read(ofile != nullptr ? counter_values[search_type] : warmup_values);
+	}
+}
+
+
+void Benchmark::process_open_loop(const std::string &search_type, const std::string &mstrie_query_type, const std::vector<std::string> &tests, std::ofstream *ofile) {
+	// queries scheduled by the generator and not taken by a worker yet
+	std::queue<std::pair<size_t, std::chrono::steady_clock::time_point>> requests;
+	std::mutex requests_mutex;
+	std::condition_variable requests_cv;
+	bool requests_done = false;
+	// the mstrie keeps statistics of the last query, so the queries are run one at a time
+	std::mutex manager_mutex;
+	std::exception_ptr error;
+	
+	std::vector<std::string> results(tests.size());
+	std::vector<uint64_t> times(tests.size());
+	std::vector<LatencyHistogram> worker_latencies(open_loop_workers);
+	std::vector<LatencyHistogram> worker_service_latencies(open_loop_workers);
 	
-	/* close files */
+	auto worker = [&](uint w) {
+		while (true) {
+			std::pair<size_t, std::chrono::steady_clock::time_point> request;
+			{
+				std::unique_lock<std::mutex> lock(requests_mutex);
+				requests_cv.wait(lock, [&]() { return !requests.empty() || requests_done; });
+				if (requests.empty()) return;
+				request = requests.front();
+				requests.pop();
+			}
+			try {
+				std::lock_guard<std::mutex> lock(manager_mutex);
+				TraceSpan span("query");
+				auto tp_start = std::chrono::steady_clock::now();
+				results[request.first] = manager->retrieve_query(mstrie_query_type, tests[request.first]);
+				auto tp_end = std::chrono::steady_clock::now();
+				times[request.first] = std::chrono::duration_cast<std::chrono::nanoseconds>(tp_end - request.second).count();
+				worker_latencies[w].record(times[request.first]);
+				worker_service_latencies[w].record(std::chrono::duration_cast<std::chrono::nanoseconds>(tp_end - tp_start).count());
+#ifdef MSTRIE_PROFILE
+				if (ofile != nullptr) profiles[search_type].merge(manager->last_query_profile());
+#endif
+			} catch (std::exception &e) {
+				std::lock_guard<std::mutex> lock(requests_mutex);
+				if (!error) error = std::current_exception();
+			}
+		}
+	};
+	std::vector<std::thread> workers;
+	for (uint w = 0; w < open_loop_workers; w++) {
+		workers.emplace_back(worker, w);
+	}
 	
+	/* the calling thread generates the arrivals, a late arrival is issued at once and keeps its scheduled time */
+	auto tp_run_start = std::chrono::steady_clock::now();
+	double offset = 0;
+	for (size_t i = 0; i < tests.size(); i++) {
+		if (open_loop_arrival.compare("poisson") == 0) {
+			offset += -std::log(1 - (arrival_rng() >> 11) * (1.0 / 9007199254740992.0)) / open_loop_rate;
+		}
+		else {
+			offset = i / open_loop_rate;
+		}
+		auto tp_scheduled = tp_run_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(offset));
+		std::this_thread::sleep_until(tp_scheduled);
+		{
+			std::lock_guard<std::mutex> lock(requests_mutex);
+			requests.emplace(i, tp_scheduled);
+		}
+		requests_cv.notify_one();
+	}
+	{
+		std::lock_guard<std::mutex> lock(requests_mutex);
+		requests_done = true;
+	}
+	requests_cv.notify_all();
+	for (auto &w : workers) {
+		w.join();
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+	if (ofile == nullptr) return;
+	
+	measured_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - tp_run_start).count();
+	for (uint w = 0; w < open_loop_workers; w++) {
+		latencies[search_type].merge(worker_latencies[w]);
+		service_latencies[search_type].merge(worker_service_latencies[w]);
+	}
+	TraceSpan io_span("io");
+	for (size_t i = 0; i < tests.size(); i++) {
+		*ofile<<tests[i]<<";"<<results[i]<<";"<<times[i] / 1000<<"µs\n";
+	}
+}
+
+
+void Benchmark::write_summary(const std::string &summary_file_name, const std::string &summary_format) {
+	LatencyHistogram total;
+	for (auto &latency : latencies) {
+		total.merge(latency.second);
+	}
+	auto memory = manager->memory_stats();
+	
+	// throughput of a query type counts only the time spent in its queries,
+	// in open loop the latencies overlap and the wall time is counted
+	auto throughput = [](uint64_t count, uint64_t time) {
+		return time > 0 ? count * 1e9 / time : 0;
+	};
+	auto query_time = [this](const LatencyHistogram &histogram) {
+		return open_loop_rate > 0 ? measured_time : histogram.sum();
+	};
+	if (perf_counters != nullptr) {
+		for (size_t i = 0; i < perf_counters->names().size(); i++) {
+			if (!perf_counters->counted(i)) {
+				std::cout<<"Hardware counter "<<perf_counters->names()[i]<<" was never scheduled by the kernel, it is not reported."<<std::endl;
+			}
+		}
+	}
+	std::ostringstream summary;
+	if (summary_format.compare("json") == 0) {
+		auto json_entry = [&summary, &throughput](const std::string &name, const LatencyHistogram &histogram, uint64_t time) {
+			summary<<"\t\t\""<<name<<"\": {";
+			summary<<"\"count\": "<<histogram.count();
+			summary<<", \"throughput_qps\": "<<throughput(histogram.count(), time);
+			summary<<", \"min_ns\": "<<histogram.min();
+			summary<<", \"mean_ns\": "<<histogram.mean();
+			summary<<", \"p50_ns\": "<<histogram.percentile(50);
+			summary<<", \"p90_ns\": "<<histogram.percentile(90);
+			summary<<", \"p99_ns\": "<<histogram.percentile(99);
+			summary<<", \"p99.9_ns\": "<<histogram.percentile(99.9);
+			summary<<", \"max_ns\": "<<histogram.max();
+			summary<<"}";
+		};
+		summary<<"{\n";
+		summary<<"\t\"mstrie\": \""<<config->get_value<std::string>("benchmark:mstrie_name")<<"\",\n";
+		summary<<"\t\"warmup\": "<<config->get_value<uint>("benchmark:run:warmup", 0)<<",\n";
+		summary<<"\t\"repetitions\": "<<config->get_value<uint>("benchmark:run:repetitions", 1)<<",\n";
+		if (open_loop_rate > 0) {
+			summary<<"\t\"open_loop\": {\"arrival\": \""<<open_loop_arrival<<"\"";
+			summary<<", \"workers\": "<<open_loop_workers;
+			summary<<", \"target_qps\": "<<open_loop_rate;
+			summary<<", \"achieved_qps\": "<<throughput(total.count(), measured_time)<<"},\n";
+		}
+		summary<<"\t\"queries\": {\n";
+		for (auto &latency : latencies) {
+			json_entry(latency.first, latency.second, query_time(latency.second));
+			summary<<",\n";
+		}
+		json_entry("total", total, measured_time);
+		summary<<"\n\t}";
+		if (!service_latencies.empty()) {
+			summary<<",\n\t\"service\": {\n";
+			for (auto it = service_latencies.begin(); it != service_latencies.end(); it++) {
+				if (it != service_latencies.begin()) summary<<",\n";
+				json_entry(it->first, it->second, it->second.sum());
+			}
+			summary<<"\n\t}";
+		}
+		auto json_array = [&summary](const std::vector<unsigned long> &values) {
+			summary<<"[";
+			for (size_t i = 0; i < values.size(); i++) {
+				summary<<(i > 0 ? ", " : "")<<values[i];
+			}
+			summary<<"]";
+		};
+		summary<<",\n\t\"memory\": {\"total_bytes\": "<<memory.total_bytes();
+		summary<<", \"node_bytes\": "<<memory.node_bytes;
+		summary<<", \"child_array_bytes\": "<<memory.child_array_bytes;
+		summary<<", \"allocator_overhead_bytes\": "<<memory.allocator_overhead;
+		summary<<", \"allocator_free_bytes\": "<<memory.allocator_free;
+		summary<<", \"hash_index_bytes\": "<<memory.hash_index_bytes;
+		summary<<", \"filter_bytes\": "<<memory.filter_bytes;
+		summary<<", \"level_nodes\": ";
+		json_array(memory.level_nodes);
+		summary<<", \"level_bytes\": ";
+		json_array(memory.level_bytes);
+		summary<<", \"fanout\": ";
+		json_array(memory.fanout);
+		summary<<"}";
+		if (!counter_values.empty()) {
+			summary<<",\n\t\"counters\": {\n";
+			for (auto it = counter_values.begin(); it != counter_values.end(); it++) {
+				if (it != counter_values.begin()) summary<<",\n";
+				uint64_t queries = latencies[it->first].count();
+				uint64_t nodes = traversed_nodes[it->first];
+				summary<<"\t\t\""<<it->first<<"\": {\"traversed_nodes\": "<<nodes;
+				for (size_t i = 0; i < it->second.size(); i++) {
+					if (!perf_counters->counted(i)) continue;
+					summary<<", \""<<perf_counters->names()[i]<<"\": {\"total\": "<<it->second[i];
+					summary<<", \"per_query\": "<<(queries > 0 ? static_cast<double>(it->second[i]) / queries : 0);
+					summary<<", \"per_node\": "<<(nodes > 0 ? static_cast<double>(it->second[i]) / nodes : 0)<<"}";
+				}
+				summary<<"}";
+			}
+			summary<<"\n\t}";
+		}
+		if (!profiles.empty()) {
+			summary<<",\n\t\"profile\": {\n";
+			for (auto it = profiles.begin(); it != profiles.end(); it++) {
+				if (it != profiles.begin()) summary<<",\n";
+				summary<<"\t\t\""<<it->first<<"\": {\"results\": "<<it->second.results;
+				summary<<", \"visited\": ";
+				json_array(it->second.visited_nodes);
+				summary<<", \"limit_pruned\": ";
+				json_array(it->second.limit_pruned);
+				summary<<", \"dead_ends\": ";
+				json_array(it->second.dead_ends);
+				summary<<"}";
+			}
+			summary<<"\n\t}";
+		}
+		summary<<"\n}\n";
+	}
+	else {
+		auto csv_entry = [&summary, &throughput](const std::string &name, const LatencyHistogram &histogram, uint64_t time) {
+			summary<<name<<";"<<histogram.count()<<";"<<throughput(histogram.count(), time)<<";";
+			summary<<histogram.min()<<";"<<histogram.mean()<<";";
+			summary<<histogram.percentile(50)<<";"<<histogram.percentile(90)<<";"<<histogram.percentile(99)<<";"<<histogram.percentile(99.9)<<";";
+			summary<<histogram.max()<<"\n";
+		};
+		summary<<"query;count;throughput_qps;min_ns;mean_ns;p50_ns;p90_ns;p99_ns;p99.9_ns;max_ns\n";
+		for (auto &latency : latencies) {
+			csv_entry(latency.first, latency.second, query_time(latency.second));
+		}
+		csv_entry("total", total, measured_time);
+		for (auto &latency : service_latencies) {
+			csv_entry(latency.first + ":service", latency.second, latency.second.sum());
+		}
+		// the memory and the profile are further tables after an empty line
+		summary<<"\nmemory;total_bytes;node_bytes;child_array_bytes;allocator_overhead_bytes;allocator_free_bytes;hash_index_bytes;filter_bytes\n";
+		summary<<"mstrie;"<<memory.total_bytes()<<";"<<memory.node_bytes<<";"<<memory.child_array_bytes<<";";
+		summary<<memory.allocator_overhead<<";"<<memory.allocator_free<<";"<<memory.hash_index_bytes<<";"<<memory.filter_bytes<<"\n";
+		summary<<"\nlevel;nodes;bytes\n";
+		for (size_t level = 0; level < memory.level_nodes.size(); level++) {
+			summary<<level<<";"<<memory.level_nodes[level]<<";"<<memory.level_bytes[level]<<"\n";
+		}
+		summary<<"\nchildren;nodes\n";
+		for (size_t children = 0; children < memory.fanout.size(); children++) {
+			summary<<children<<";"<<memory.fanout[children]<<"\n";
+		}
+		if (!counter_values.empty()) {
+			summary<<"\nquery;counter;total;per_query;per_node\n";
+			for (auto &values : counter_values) {
+				uint64_t queries = latencies[values.first].count();
+				uint64_t nodes = traversed_nodes[values.first];
+				summary<<values.first<<";traversed_nodes;"<<nodes<<";"<<(queries > 0 ? static_cast<double>(nodes) / queries : 0)<<";1\n";
+				for (size_t i = 0; i < values.second.size(); i++) {
+					if (!perf_counters->counted(i)) continue;
+					summary<<values.first<<";"<<perf_counters->names()[i]<<";"<<values.second[i]<<";";
+					summary<<(queries > 0 ? static_cast<double>(values.second[i]) / queries : 0)<<";";
+					summary<<(nodes > 0 ? static_cast<double>(values.second[i]) / nodes : 0)<<"\n";
+				}
+			}
+		}
+		if (!profiles.empty()) {
+			summary<<"\nquery;level;visited;limit_pruned;dead_ends\n";
+			for (auto &profile : profiles) {
+				for (size_t level = 0; level < profile.second.visited_nodes.size(); level++) {
+					summary<<profile.first<<";"<<level<<";"<<profile.second.visited_nodes[level]<<";";
+					summary<<profile.second.limit_pruned[level]<<";"<<profile.second.dead_ends[level]<<"\n";
+				}
+			}
+		}
+	}
+	FileUtils::write_file(summary_file_name, summary.str());
+}
+
+
+void Benchmark::generate_workload(const std::string &search_type, const std::string &test_file_name) {
+	auto mstrie = config->get_value<std::string>("benchmark:mstrie_name");
+	WorkloadGenerator generator(*config, "benchmark:generator", config->get_value<uint>(mstrie + ":alphabet_length"), config->get_value<uint>(mstrie + ":max_multiplicity"));
+	auto multisets = config->get_value<unsigned long long>("benchmark:generator:multisets", 0);
+	auto queries = config->get_value<uint>("benchmark:generator:queries", 0);
+	// the share of queries derived from stored multisets
+	auto hit_ratio = config->get_value<double>("benchmark:generator:hit_ratio", 0.5);
+	std::mt19937_64 sampler(config->get_value<unsigned long long>("benchmark:generator:seed", 1));
+	
+	/* populate the mstrie, keeping a uniform sample of stored multisets */
+	auto tp_start = std::chrono::steady_clock::now();
+	std::vector<std::vector<uint>> sample;
+	sample.reserve(queries);
+	for (unsigned long long i = 0; i < multisets; i++) {
+		auto v = generator.generate();
+		manager->update_query("+", WorkloadGenerator::to_string(v));
+		if (sample.size() < queries) {
+			sample.push_back(v);
+		}
+		else if (queries > 0) {
+			auto j = sampler() % (i + 1);
+			if (j < queries) sample[j] = v;
+		}
+	}
+	auto time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tp_start).count();
+	std::cout<<"Populated mstrie with "<<multisets<<" generated multisets in "<<time_taken<<" ms."<<std::endl;
+	
+	/* generate queries */
+	std::ofstream test_file;
+	test_file.exceptions( std::ofstream::badbit | std::ofstream::failbit );
+	test_file.open(test_file_name);
+	if (!test_file.is_open()) {
+		throw std::runtime_error("ERROR: File "+test_file_name+" can't be opened.");
+	}
+	for (uint i = 0; i < queries; i++) {
+		std::vector<uint> v;
+		bool hit = !sample.empty() && (sampler() >> 11) * (1.0 / 9007199254740992.0) < hit_ratio;
+		if (!hit) {
+			v = generator.generate();
+		}
+		else if (search_type.compare("subset_search") == 0) {
+			// the stored multiset is a submultiset of the query
+			v = generator.extend(sample[sampler() % sample.size()]);
+		}
+		else if (search_type.compare("superset_search") == 0) {
+			// the stored multiset is a supermultiset of the query
+			v = generator.reduce(sample[sampler() % sample.size()]);
+		}
+		else {
+			v = sample[sampler() % sample.size()];
+		}
+		test_file<<WorkloadGenerator::to_string(v)<<"\n";
+	}
 	test_file.close();
-	result_file.close();
 }
 
 
-void Benchmark::process(const std::string &mstrie_query_type, std::ifstream &ifile, std::ofstream &ofile) {
-	// result file header
-	ofile<<"test;output;time_μs"<<std::endl;
+void Benchmark::populate_mixed_workload() {
+	auto mstrie = config->get_value<std::string>("benchmark:mstrie_name");
+	mixed_workload = std::make_unique<MixedWorkload>(*config, "benchmark:mixed", "benchmark:generator", config->get_value<uint>(mstrie + ":alphabet_length"), config->get_value<uint>(mstrie + ":max_multiplicity"));
+	auto multisets = config->get_value<unsigned long long>("benchmark:generator:multisets", 0);
 	
-	std::string test;
-	while(std::getline(ifile, test)) {
-		auto result = manager->retrieve_query(mstrie_query_type, test);
-		ofile<<test<<";"<<result<<";"<<manager->print_benchmark_stats();
-		ofile<<std::endl;
+	auto tp_start = std::chrono::steady_clock::now();
+	for (unsigned long long i = 0; i < multisets; i++) {
+		auto v = mixed_workload->generate();
+		int stored = manager->number_of_multisets();
+		manager->update_query("+", WorkloadGenerator::to_string(v));
+		// a generated multiset may be stored already
+		if (manager->number_of_multisets() > stored) {
+			mixed_workload->store(v);
+		}
+	}
+	auto time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tp_start).count();
+	std::cout<<"Populated mstrie with "<<multisets<<" generated multisets in "<<time_taken<<" ms."<<std::endl;
+}
+
+
+void Benchmark::process_mixed(unsigned long long operations, std::ofstream *ofile, std::ofstream *timeline) {
+	auto tp_run_start = std::chrono::steady_clock::now();
+	for (unsigned long long i = 0; i < operations; i++) {
+		TraceSpan span("query");
+		auto operation = mixed_workload->next();
+		auto test = WorkloadGenerator::to_string(operation.multiset);
+		std::string result;
+		int stored = manager->number_of_multisets();
+		
+		if (perf_counters != nullptr) perf_counters->start();
+		auto tp_start = std::chrono::steady_clock::now();
+		switch (operation.kind) {
+			case MixedOperation::update:
+				manager->update_query(operation.query_type, test);
+				break;
+			case MixedOperation::search:
+				result = manager->search_query(operation.query_type, test, operation.limit) ? "1" : "0";
+				break;
+			case MixedOperation::retrieve:
+				result = manager->retrieve_query(operation.query_type, test, operation.limit);
+				break;
+		}
+		auto tp_end = std::chrono::steady_clock::now();
+		if (perf_counters != nullptr) perf_counters->stop();
+		
+		if (operation.query_type.compare("+") == 0 && manager->number_of_multisets() > stored) {
+			mixed_workload->store(operation.multiset);
+		}
+		if (ofile == nullptr) {
+			std::vector<uint64_t> warmup_values;
+			if (perf_counters != nullptr) perf_counters->read(warmup_values);
+			continue;
+		}
+		
+		uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(tp_end - tp_start).count();
+		latencies[operation.name].record(latency);
+		traversed_nodes[operation.name] += manager->last_query_traversed_nodes();
+		if (perf_counters != nullptr) perf_counters->read(counter_values[operation.name]);
+#ifdef MSTRIE_PROFILE
+		profiles[operation.name].merge(manager->last_query_profile());
+#endif
+		TraceSpan io_span("io");
+		*ofile<<operation.name<<";"<<test<<";"<<result<<";"<<latency / 1000<<"µs\n";
+		if (++measured_operations % sample_interval == 0) {
+			write_sample(*timeline);
+		}
+	}
+	if (ofile != nullptr) {
+		measured_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - tp_run_start).count();
+	}
+}
+
+
+void Benchmark::write_sample(std::ofstream &timeline) {
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tp_measured_start).count();
+	timeline<<measured_operations<<";"<<elapsed<<";"<<manager->number_of_nodes()<<";"<<manager->number_of_multisets()<<";"<<resident_memory()<<"\n";
+}
+
+
+unsigned long Benchmark::resident_memory() {
+	// the second field is the number of resident pages
+	std::ifstream statm("/proc/self/statm");
+	unsigned long size = 0, resident = 0;
+	if (!(statm>>size>>resident)) {
+		return 0;
 	}
+	return resident * sysconf(_SC_PAGESIZE);
 }
@@ -9,6 +9,11 @@
 #ifndef BENCHMARK_HPP
 #define BENCHMARK_HPP
 
+#include <map>
+#include <random>
+#include "latency_histogram.hpp"
+#include "mixed_workload.hpp"
+#include "perf_counters.hpp"
 #include "../core/index_manager.hpp"
 #include "../lib/configurator.hpp"
 
@@ -16,7 +21,52 @@ class Benchmark {
 private:
 	std::unique_ptr<Configurator> config;
 	std::unique_ptr<MstrieManager> manager;
-	void process(const std::string &mstrie_query_type, std::ifstream &ifile, std::ofstream &ofile);
+	
+	// latencies of the measured queries per benchmark type
+	std::map<std::string, LatencyHistogram> latencies;
+	// wall time of the measured queries in nanoseconds
+	uint64_t measured_time;
+	// per-level statistics of the measured queries, recorded only with MSTRIE_PROFILE
+	std::map<std::string, MstrieProfile> profiles;
+	
+	// hardware counters, counting only while a query runs
+	std::unique_ptr<PerfCounters> perf_counters;
+	std::map<std::string, std::vector<uint64_t>> counter_values;
+	std::map<std::string, uint64_t> traversed_nodes;
+	
+	// runs queries once, the results are written and measured only if ofile is given
+	void process(const std::string &search_type, const std::string &mstrie_query_type, const std::vector<std::string> &tests, std::ofstream *ofile);
+	
+	/* open loop */
+	// target arrival rate in queries per second, 0 - closed loop
+	double open_loop_rate;
+	// constant | poisson
+	std::string open_loop_arrival;
+	uint open_loop_workers;
+	std::mt19937_64 arrival_rng;
+	// time the queries spent in the mstrie, without waiting for a worker
+	std::map<std::string, LatencyHistogram> service_latencies;
+	
+	// issues queries at their arrival times to a pool of workers,
+	// the latency is measured from the time the query was scheduled
+	void process_open_loop(const std::string &search_type, const std::string &mstrie_query_type, const std::vector<std::string> &tests, std::ofstream *ofile);
+	void write_summary(const std::string &summary_file_name, const std::string &summary_format);
+	// populates the mstrie and writes the test file with generated multisets
+	void generate_workload(const std::string &search_type, const std::string &test_file_name);
+	
+	/* mixed workload */
+	std::unique_ptr<MixedWorkload> mixed_workload;
+	// the size of the mstrie is sampled every sample_interval measured operations
+	unsigned long long sample_interval;
+	unsigned long long measured_operations;
+	std::chrono::steady_clock::time_point tp_measured_start;
+	
+	void populate_mixed_workload();
+	// runs operations once, the results and samples are written and measured only if ofile is given
+	void process_mixed(unsigned long long operations, std::ofstream *ofile, std::ofstream *timeline);
+	void write_sample(std::ofstream &timeline);
+	// resident set size of the process in bytes, 0 if unknown
+	static unsigned long resident_memory();
 public:
 	Benchmark(const Configurator &config);
 	void run();
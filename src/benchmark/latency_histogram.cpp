@@ -0,0 +1,117 @@
+//
+//  latency_histogram.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include "latency_histogram.hpp"
+
+// values below 2^SUB_BITS are exact, larger values keep SUB_BITS significant bits
+#define SUB_BITS 7
+#define SUB_COUNT (1 << SUB_BITS)
+#define HALF_SUB_COUNT (1 << (SUB_BITS - 1))
+
+
+LatencyHistogram::LatencyHistogram() {
+	// one exact range and a half range for every further power of two
+	buckets = std::vector<uint64_t>(SUB_COUNT + (64 - SUB_BITS) * HALF_SUB_COUNT, 0);
+	total_count = 0;
+	total_sum = 0;
+	min_value = UINT64_MAX;
+	max_value = 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+size_t LatencyHistogram::bucket_index(uint64_t value) {
+	if (value < SUB_COUNT) {
+		return value;
+	}
+	int msb = 63 - __builtin_clzll(value);
+	int shift = msb - (SUB_BITS - 1);
+	return SUB_COUNT + (shift - 1) * HALF_SUB_COUNT + ((value >> shift) - HALF_SUB_COUNT);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint64_t LatencyHistogram::bucket_value(size_t index) {
+	if (index < SUB_COUNT) {
+		return index;
+	}
+	int shift = (index - SUB_COUNT) / HALF_SUB_COUNT + 1;
+	uint64_t sub = (index - SUB_COUNT) % HALF_SUB_COUNT + HALF_SUB_COUNT;
+	return ((sub + 1) << shift) - 1;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void LatencyHistogram::record(uint64_t value) {
+	buckets[bucket_index(value)]++;
+	total_count++;
+	total_sum += value;
+	min_value = std::min(min_value, value);
+	max_value = std::max(max_value, value);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void LatencyHistogram::merge(const LatencyHistogram &histogram) {
+	for (size_t i = 0; i < buckets.size(); i++) {
+		buckets[i] += histogram.buckets[i];
+	}
+	total_count += histogram.total_count;
+	total_sum += histogram.total_sum;
+	min_value = std::min(min_value, histogram.min_value);
+	max_value = std::max(max_value, histogram.max_value);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint64_t LatencyHistogram::count() const {
+	return total_count;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint64_t LatencyHistogram::sum() const {
+	return total_sum;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint64_t LatencyHistogram::min() const {
+	return total_count > 0 ? min_value : 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint64_t LatencyHistogram::max() const {
+	return max_value;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+double LatencyHistogram::mean() const {
+	return total_count > 0 ? static_cast<double>(total_sum) / total_count : 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+	if (total_count == 0) {
+		return 0;
+	}
+	uint64_t rank = std::max<uint64_t>(1, std::ceil(percent / 100 * total_count));
+	uint64_t seen = 0;
+	for (size_t i = 0; i < buckets.size(); i++) {
+		seen += buckets[i];
+		if (seen >= rank) {
+			// the bucket bound may exceed the largest recorded value
+			return std::min(bucket_value(i), max_value);
+		}
+	}
+	return max_value;
+}
@@ -0,0 +1,47 @@
+//
+//  latency_histogram.hpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#ifndef LATENCY_HISTOGRAM_HPP
+#define LATENCY_HISTOGRAM_HPP
+
+#include <cstdint>
+#include <vector>
+
+
+/* Histogram of latencies in nanoseconds with logarithmic buckets
+ *
+ * Values below 128 are counted exactly, larger values are counted in
+ * buckets that keep the 7 most significant bits of the value, so any
+ * reported value is within 1/64 of the recorded one.
+ */
+class LatencyHistogram {
+private:
+	std::vector<uint64_t> buckets;
+	uint64_t total_count;
+	uint64_t total_sum;
+	uint64_t min_value;
+	uint64_t max_value;
+
+	static size_t bucket_index(uint64_t value);
+	// the highest value counted in the bucket
+	static uint64_t bucket_value(size_t index);
+public:
+	LatencyHistogram();
+
+	void record(uint64_t value);
+	void merge(const LatencyHistogram &histogram);
+
+	uint64_t count() const;
+	uint64_t sum() const;
+	uint64_t min() const;
+	uint64_t max() const;
+	double mean() const;
+	// the value that is greater or equal than the given percent of the recorded values
+	uint64_t percentile(double percent) const;
+};
+
+#endif /* LATENCY_HISTOGRAM_HPP */
@@ -0,0 +1,141 @@
+//
+//  mixed_workload.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include "mixed_workload.hpp"
+
+
+MixedOperation::MixedOperation(const std::string &name, Kind kind, const std::string &query_type)
+: name(name),
+kind(kind),
+query_type(query_type),
+limit(-1) {
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+MixedWorkload::MixedWorkload(Configurator &config, const std::string &group, const std::string &generator_group, uint alphabet, uint max_multiplicity)
+: generator(config, generator_group, alphabet, max_multiplicity) {
+	operations = {
+		MixedOperation("insert", MixedOperation::update, "+"),
+		MixedOperation("delete", MixedOperation::update, "-"),
+		MixedOperation("exact", MixedOperation::search, "="),
+		MixedOperation("subset_exists", MixedOperation::search, "<="),
+		MixedOperation("superset_exists", MixedOperation::search, ">="),
+		MixedOperation("retrieve_subset", MixedOperation::retrieve, "<="),
+		MixedOperation("retrieve_superset", MixedOperation::retrieve, ">=")
+	};
+	const std::vector<double> default_ratios = { 0.1, 0.1, 0.5, 0.15, 0.15, 0, 0 };
+	double sum = 0;
+	for (uint i = 0; i < operations.size(); i++) {
+		double ratio = config.get_value<double>(group + ":" + operations[i].name + "_ratio", default_ratios[i]);
+		if (ratio < 0) {
+			throw std::runtime_error("Ratio of " + operations[i].name + " operations is negative.");
+		}
+		sum += ratio;
+		operation_cdf.push_back(sum);
+	}
+	if (sum <= 0) {
+		throw std::runtime_error("Ratios of mixed workload operations sum up to zero.");
+	}
+	for (auto &p : operation_cdf) {
+		p /= sum;
+	}
+
+	hit_ratio = config.get_value<double>(group + ":hit_ratio", 0.5);
+	limit_distribution = config.get_value<std::string>(group + ":limit_distribution", "none");
+	limit_min = config.get_value<uint>(group + ":limit_min", 0);
+	limit_max = config.get_value<uint>(group + ":limit_max", max_multiplicity);
+	limit_p = config.get_value<double>(group + ":limit_p", 0.5);
+	if (limit_distribution.compare("none") != 0 && limit_distribution.compare("uniform") != 0 && limit_distribution.compare("geometric") != 0) {
+		throw std::runtime_error("Unknown limit distribution: " + limit_distribution);
+	}
+	if (limit_min > limit_max) {
+		throw std::runtime_error("Minimal limit is greater than maximal limit.");
+	}
+	if (limit_p <= 0 || limit_p > 1) {
+		throw std::runtime_error("Parameter limit_p must be in (0, 1].");
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+int MixedWorkload::draw_limit() {
+	if (limit_distribution.compare("uniform") == 0) {
+		return generator.draw_uniform(limit_min, limit_max);
+	}
+	if (limit_distribution.compare("geometric") == 0) {
+		// the number of failures before the first success, shifted by limit_min
+		double failures = limit_p >= 1 ? 0 : std::floor(std::log(1 - generator.draw_uniform()) / std::log(1 - limit_p));
+		return static_cast<int>(std::min<double>(limit_min + failures, limit_max));
+	}
+	return -1;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::vector<uint> MixedWorkload::generate() {
+	return generator.generate();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MixedWorkload::store(const std::vector<uint> &v) {
+	stored.push_back(v);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+MixedOperation MixedWorkload::next() {
+	auto it = std::upper_bound(operation_cdf.begin(), operation_cdf.end(), generator.draw_uniform());
+	MixedOperation operation = operations[std::min<size_t>(it - operation_cdf.begin(), operations.size() - 1)];
+
+	// nothing to delete, the mstrie grows instead
+	if (operation.name.compare("delete") == 0 && stored.empty()) {
+		operation = operations[0];
+	}
+
+	if (operation.name.compare("insert") == 0) {
+		operation.multiset = generator.generate();
+	}
+	else if (operation.name.compare("delete") == 0) {
+		uint i = generator.draw_uniform(0, stored.size() - 1);
+		operation.multiset = std::move(stored[i]);
+		stored[i] = std::move(stored.back());
+		stored.pop_back();
+	}
+	else if (stored.empty() || generator.draw_uniform() >= hit_ratio) {
+		operation.multiset = generator.generate();
+	}
+	else {
+		auto &v = stored[generator.draw_uniform(0, stored.size() - 1)];
+		if (operation.query_type.compare("<=") == 0) {
+			// the stored multiset is a submultiset of the query
+			operation.multiset = generator.extend(v);
+		}
+		else if (operation.query_type.compare(">=") == 0) {
+			// the stored multiset is a supermultiset of the query
+			operation.multiset = generator.reduce(v);
+		}
+		else {
+			operation.multiset = v;
+		}
+	}
+
+	if (operation.query_type.compare("<=") == 0 || operation.query_type.compare(">=") == 0) {
+		operation.limit = draw_limit();
+	}
+	return operation;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+size_t MixedWorkload::stored_size() const {
+	return stored.size();
+}
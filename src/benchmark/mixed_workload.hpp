@@ -0,0 +1,69 @@
+//
+//  mixed_workload.hpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#ifndef MIXED_WORKLOAD_HPP
+#define MIXED_WORKLOAD_HPP
+
+#include <string>
+#include <vector>
+#include "workload_generator.hpp"
+#include "../lib/configurator.hpp"
+
+
+/* Operation of the mixed workload */
+class MixedOperation {
+public:
+	enum Kind { update, search, retrieve };
+
+	// insert, delete, exact, subset_exists, superset_exists, retrieve_subset or retrieve_superset
+	std::string name;
+	Kind kind;
+	// query type of the manager: + | - | = | <= | >=
+	std::string query_type;
+	std::vector<uint> multiset;
+	// -1 - no limit
+	int limit;
+
+	MixedOperation(const std::string &name, Kind kind, const std::string &query_type);
+};
+
+/* Generator of interleaved updates and queries
+ *
+ * The operations are drawn by their configured ratios. Deletes and the
+ * queries that should match take the multisets the workload inserted
+ * and did not delete yet, so every delete succeeds.
+ */
+class MixedWorkload {
+private:
+	WorkloadGenerator generator;
+
+	std::vector<MixedOperation> operations;
+	// cumulative ratios of operations
+	std::vector<double> operation_cdf;
+	// the share of queries derived from stored multisets
+	double hit_ratio;
+	std::string limit_distribution;
+	uint limit_min;
+	uint limit_max;
+	double limit_p;
+
+	// multisets inserted by the workload that were not deleted yet
+	std::vector<std::vector<uint>> stored;
+
+	int draw_limit();
+public:
+	// reads the ratios from configuration group and the multiset distribution from generator_group
+	MixedWorkload(Configurator &config, const std::string &group, const std::string &generator_group, uint alphabet, uint max_multiplicity);
+
+	std::vector<uint> generate();
+	// to be called for every multiset that was inserted into the mstrie
+	void store(const std::vector<uint> &v);
+	MixedOperation next();
+	size_t stored_size() const;
+};
+
+#endif /* MIXED_WORKLOAD_HPP */
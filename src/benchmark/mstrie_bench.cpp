@@ -0,0 +1,269 @@
+//
+//  mstrie_bench.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "latency_histogram.hpp"
+#include "../core/mstrie.hpp"
+
+
+/* Shape of a generated mstrie */
+class BenchShape {
+public:
+	const std::string name;
+	const uint alphabet;
+	const uint max_multiplicity;
+	const uint multisets;
+	const uint cardinality_min;
+	const uint cardinality_max;
+
+	BenchShape(const std::string &name, uint alphabet, uint max_multiplicity, uint multisets, uint cardinality_min, uint cardinality_max)
+	: name(name), alphabet(alphabet), max_multiplicity(max_multiplicity), multisets(multisets), cardinality_min(cardinality_min), cardinality_max(cardinality_max) { }
+};
+
+/* Generated mstrie with the words of the benchmark inputs
+ *
+ * The same seed is used for every shape, so the fixture is the same in
+ * every run and the results of two versions can be compared line by line.
+ */
+class BenchFixture {
+private:
+	std::mt19937_64 rng;
+
+	// uniform in [min, max]
+	uint draw(uint min, uint max);
+	std::vector<uint> generate();
+public:
+	const BenchShape &shape;
+	std::unique_ptr<MstrieStructure> mstrie;
+
+	// multiplicity vectors and words of stored multisets
+	std::vector<std::vector<uint>> vectors;
+	std::vector<std::string> stored;
+	// words of multisets that are not stored
+	std::vector<std::string> absent;
+	// words of multisets that have a stored submultiset or supermultiset
+	std::vector<std::string> supersets;
+	std::vector<std::string> subsets;
+
+	BenchFixture(const BenchShape &shape, uint inputs);
+};
+
+/* Runner of benchmarks
+ *
+ * An operation is run over all its inputs, the passes are repeated until
+ * the minimal time is reached. Every benchmark is written as one line:
+ * name;iterations;ns_per_op;min_ns;p50_ns;p99_ns;max_ns
+ */
+class BenchRunner {
+private:
+	const std::string filter;
+	const std::chrono::nanoseconds min_time;
+public:
+	BenchRunner(const std::string &filter, long min_time_ms);
+
+	// setup is run before every pass and is not measured
+	void run(const std::string &name, size_t inputs, const std::function<void(size_t)> &operation, const std::function<void()> &setup = nullptr);
+};
+
+// ===============================================================================================
+// ===============================================================================================
+
+BenchFixture::BenchFixture(const BenchShape &shape, uint inputs)
+: rng(42),
+shape(shape) {
+	mstrie = std::make_unique<MstrieStructure>(MstrieSettings(shape.alphabet, shape.max_multiplicity, ""));
+	for (uint i = 0; i < shape.multisets; i++) {
+		mstrie->pub_mstrie_insert(mstrie->num_to_str(generate()));
+	}
+
+	/* inputs are drawn from the stored multisets in trie order */
+	std::string dump = mstrie->retrieve_mstrie();
+	std::vector<std::string> words;
+	size_t begin = dump.find('\n') + 1;
+	while (begin > 0 && begin < dump.size()) {
+		size_t end = dump.find('\n', begin);
+		words.push_back(dump.substr(begin, end - begin));
+		begin = end + 1;
+	}
+	for (uint i = 0; i < inputs && !words.empty(); i++) {
+		stored.push_back(words[draw(0, words.size() - 1)]);
+		vectors.push_back(mstrie->str_to_num(stored.back()));
+	}
+	while (absent.size() < inputs) {
+		auto word = mstrie->num_to_str(generate());
+		if (!mstrie->pub_mstrie_search(word)) absent.push_back(word);
+	}
+	for (auto &v : vectors) {
+		auto superset = v;
+		for (uint extra = draw(1, 3); extra > 0; extra--) {
+			uint element = draw(0, shape.alphabet - 1);
+			if (superset[element] < shape.max_multiplicity) superset[element]++;
+		}
+		supersets.push_back(mstrie->num_to_str(superset));
+
+		auto subset = v;
+		for (uint removed = draw(1, 3); removed > 0; removed--) {
+			uint element = draw(0, shape.alphabet - 1);
+			if (subset[element] > 0) subset[element]--;
+		}
+		subsets.push_back(mstrie->num_to_str(subset));
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint BenchFixture::draw(uint min, uint max) {
+	return min + static_cast<uint>(rng() % (static_cast<unsigned long long>(max) - min + 1));
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::vector<uint> BenchFixture::generate() {
+	std::vector<uint> v (shape.alphabet, 0);
+	uint cardinality = draw(shape.cardinality_min, shape.cardinality_max);
+	for (uint i = 0; i < cardinality; i++) {
+		uint element = draw(0, shape.alphabet - 1);
+		if (v[element] < shape.max_multiplicity) v[element]++;
+	}
+	return v;
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+BenchRunner::BenchRunner(const std::string &filter, long min_time_ms)
+: filter(filter),
+min_time(std::chrono::milliseconds(min_time_ms)) {
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void BenchRunner::run(const std::string &name, size_t inputs, const std::function<void(size_t)> &operation, const std::function<void()> &setup) {
+	if (name.find(filter) == std::string::npos || inputs == 0) {
+		return;
+	}
+	LatencyHistogram histogram;
+	std::chrono::nanoseconds elapsed(0);
+	do {
+		if (setup) setup();
+		for (size_t i = 0; i < inputs; i++) {
+			auto tp_start = std::chrono::steady_clock::now();
+			operation(i);
+			auto tp_end = std::chrono::steady_clock::now();
+			histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(tp_end - tp_start).count());
+			elapsed += tp_end - tp_start;
+		}
+	} while (elapsed < min_time);
+	std::cout<<name<<";"<<histogram.count()<<";"<<static_cast<uint64_t>(histogram.mean())<<";";
+	std::cout<<histogram.min()<<";"<<histogram.percentile(50)<<";"<<histogram.percentile(99)<<";"<<histogram.max()<<std::endl;
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+int main(int argc, const char * argv[]) {
+	if (argc > 3) {
+		std::cerr<<"Usage: mstrie_bench [filter] [min_time_ms]"<<std::endl;
+		return EXIT_FAILURE;
+	}
+	BenchRunner runner(argc > 1 ? argv[1] : "", argc > 2 ? std::stol(argv[2]) : 100);
+	const uint inputs = 200;
+	const std::vector<BenchShape> shapes = {
+		BenchShape("sparse", 32, 4, 20000, 2, 8),
+		BenchShape("dense", 8, 8, 20000, 4, 24),
+		BenchShape("wide", 64, 2, 10000, 8, 32)
+	};
+
+	try {
+		std::cout<<"benchmark;iterations;ns_per_op;min_ns;p50_ns;p99_ns;max_ns"<<std::endl;
+		for (auto &shape : shapes) {
+			BenchFixture fixture(shape, inputs);
+			auto &mstrie = *fixture.mstrie;
+			auto prefix = shape.name + "/";
+			std::string result;
+
+			/* conversion */
+			runner.run(prefix + "str_to_num", inputs, [&](size_t i) {
+				mstrie.str_to_num(fixture.stored[i]);
+			});
+			runner.run(prefix + "num_to_str", inputs, [&](size_t i) {
+				result = mstrie.num_to_str(fixture.vectors[i]);
+			});
+
+			/* updates, the mstrie is restored after every pass */
+			runner.run(prefix + "insert", inputs, [&](size_t i) {
+				mstrie.pub_mstrie_insert(fixture.absent[i]);
+			}, [&]() {
+				for (auto &word : fixture.absent) {
+					if (mstrie.pub_mstrie_search(word)) mstrie.pub_mstrie_delete(word);
+				}
+			});
+			runner.run(prefix + "delete", inputs, [&](size_t i) {
+				mstrie.pub_mstrie_delete(fixture.absent[i]);
+			}, [&]() {
+				for (auto &word : fixture.absent) {
+					mstrie.pub_mstrie_insert(word);
+				}
+			});
+
+			/* queries */
+			runner.run(prefix + "search/hit", inputs, [&](size_t i) {
+				mstrie.pub_mstrie_search(fixture.stored[i]);
+			});
+			runner.run(prefix + "search/miss", inputs, [&](size_t i) {
+				mstrie.pub_mstrie_search(fixture.absent[i]);
+			});
+			std::vector<uint> limits;
+			for (uint limit = 0; limit < std::min(3u, shape.max_multiplicity); limit++) {
+				limits.push_back(limit);
+			}
+			limits.push_back(shape.max_multiplicity);
+			for (uint limit : limits) {
+				auto suffix = "/limit=" + (limit == shape.max_multiplicity ? std::string("max") : std::to_string(limit));
+				runner.run(prefix + "subset_exists" + suffix, inputs, [&](size_t i) {
+					mstrie.pub_mstrie_subseteq(fixture.supersets[i], limit);
+				});
+				runner.run(prefix + "superset_exists" + suffix, inputs, [&](size_t i) {
+					mstrie.pub_mstrie_superseteq(fixture.subsets[i], limit);
+				});
+				runner.run(prefix + "retrieve_subset" + suffix, inputs, [&](size_t i) {
+					result = mstrie.pub_mstrie_get_subseteq(fixture.supersets[i], limit);
+				});
+				runner.run(prefix + "retrieve_superset" + suffix, inputs, [&](size_t i) {
+					result = mstrie.pub_mstrie_get_superseteq(fixture.subsets[i], limit);
+				});
+			}
+
+			/* whole mstrie in both file formats */
+			for (bool compressed : { false, true }) {
+				auto format = compressed ? std::string("compressed") : std::string("text");
+				MstrieStructure source(MstrieSettings(shape.alphabet, shape.max_multiplicity, "", false, compressed));
+				source.load_mstrie(mstrie.retrieve_mstrie());
+				auto content = source.retrieve_mstrie();
+				std::unique_ptr<MstrieStructure> target;
+				runner.run(prefix + "retrieve_mstrie/" + format, 1, [&](size_t) {
+					result = source.retrieve_mstrie();
+				});
+				runner.run(prefix + "load_mstrie/" + format, 1, [&](size_t) {
+					target->load_mstrie(content);
+				}, [&]() {
+					target = std::make_unique<MstrieStructure>(MstrieSettings(shape.alphabet, shape.max_multiplicity, ""));
+				});
+			}
+		}
+	} catch (std::exception &e) {
+		std::cerr<<"Unhandled exception occured: "<<std::string(e.what())<<std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,133 @@
+//
+//  perf_counters.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+
+PerfCounters::PerfCounters() {
+#ifdef __linux__
+	auto cache_event = [](uint64_t cache, uint64_t result) {
+		return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+	};
+	struct Counter {
+		const char *name;
+		uint32_t type;
+		uint64_t config;
+	};
+	const Counter counters[] = {
+		{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+		{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+		{ "l1d_misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+		{ "llc_misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS) },
+		{ "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+		{ "dtlb_misses", PERF_TYPE_HW_CACHE, cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS) }
+	};
+	for (auto &counter : counters) {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = counter.type;
+		attr.config = counter.config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+		if (fd < 0) {
+			if (fds.empty() && error.empty()) error = std::string(counter.name) + ": " + strerror(errno);
+			continue;
+		}
+		fds.push_back(fd);
+		counter_names.push_back(counter.name);
+		scheduled.push_back(false);
+	}
+	if (!fds.empty()) error.clear();
+#else
+	error = "perf_event_open is available only on Linux";
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------
+
+PerfCounters::~PerfCounters() {
+	for (auto fd : fds) {
+		close(fd);
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool PerfCounters::available() const {
+	return !fds.empty();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+const std::string& PerfCounters::unavailable_reason() const {
+	return error;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+const std::vector<std::string>& PerfCounters::names() const {
+	return counter_names;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool PerfCounters::counted(size_t i) const {
+	return scheduled.at(i);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void PerfCounters::start() {
+#ifdef __linux__
+	for (auto fd : fds) {
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void PerfCounters::stop() {
+#ifdef __linux__
+	for (auto fd : fds) {
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+	}
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void PerfCounters::read(std::vector<uint64_t> &values) {
+#ifdef __linux__
+	if (fds.empty()) return;
+	values.resize(fds.size(), 0);
+	for (size_t i = 0; i < fds.size(); i++) {
+		// the count, the time enabled and the time running
+		uint64_t data[3] = { 0, 0, 0 };
+		if (::read(fds[i], data, sizeof(data)) < 0) continue;
+		ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+		// a counter that has not run yet was never scheduled, it has nothing to scale
+		if (data[2] == 0) continue;
+		scheduled[i] = true;
+		// the times are not reset, so the share of time the counter ran is taken over all reads
+		values[i] += static_cast<uint64_t>(data[0] * (static_cast<double>(data[1]) / data[2]));
+	}
+#endif
+}
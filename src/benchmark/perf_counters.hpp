@@ -0,0 +1,54 @@
+//
+//  perf_counters.hpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/* Hardware counters of the calling thread
+ *
+ * Every counter is opened with perf_event_open as a group of its own, so
+ * the kernel schedules each one as soon as a hardware counter is free; a
+ * group of all of them may never fit the hardware counters at once, for
+ * example while the NMI watchdog holds one. A counter the hardware or the
+ * kernel does not provide is left out, and if none can be opened the
+ * counters are unavailable and every call does nothing. A counter the
+ * kernel never scheduled is reported as not counted.
+ */
+class PerfCounters {
+private:
+	// file descriptors of the opened counters
+	std::vector<int> fds;
+	std::vector<std::string> counter_names;
+	// whether the counter ran in any of the reads
+	std::vector<bool> scheduled;
+	std::string error;
+public:
+	PerfCounters();
+	~PerfCounters();
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator=(const PerfCounters&) = delete;
+
+	bool available() const;
+	// the reason the counters are unavailable
+	const std::string& unavailable_reason() const;
+	// the names of the opened counters, in the order of the values read
+	const std::vector<std::string>& names() const;
+	// whether counter i was ever scheduled, its values are 0 otherwise
+	bool counted(size_t i) const;
+
+	void start();
+	void stop();
+	// adds the counts since the last read to values, scaled if the counters were multiplexed
+	void read(std::vector<uint64_t> &values);
+};
+
+#endif /* PERF_COUNTERS_HPP */
@@ -0,0 +1,170 @@
+//
+//  workload_generator.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include "workload_generator.hpp"
+
+
+WorkloadGenerator::WorkloadGenerator(Configurator &config, const std::string &group, uint alphabet, uint max_multiplicity)
+: _alphabet(alphabet),
+_max_multiplicity(max_multiplicity) {
+	rng.seed(config.get_value<unsigned long long>(group + ":seed", 1));
+
+	double zipf_exponent = config.get_value<double>(group + ":zipf_exponent", 0);
+	element_cdf = std::vector<double>(alphabet);
+	double sum = 0;
+	for (uint i = 0; i < alphabet; i++) {
+		sum += 1 / std::pow(i + 1, zipf_exponent);
+		element_cdf[i] = sum;
+	}
+	for (auto &p : element_cdf) {
+		p /= sum;
+	}
+
+	cardinality_distribution = config.get_value<std::string>(group + ":cardinality_distribution", "uniform");
+	cardinality_min = config.get_value<uint>(group + ":cardinality_min", 1);
+	cardinality_max = config.get_value<uint>(group + ":cardinality_max", alphabet);
+	if (cardinality_distribution.compare("uniform") != 0 && cardinality_distribution.compare("normal") != 0) {
+		throw std::runtime_error("Unknown cardinality distribution: " + cardinality_distribution);
+	}
+	if (cardinality_min > cardinality_max) {
+		throw std::runtime_error("Minimal cardinality is greater than maximal cardinality.");
+	}
+
+	multiplicity_distribution = config.get_value<std::string>(group + ":multiplicity_distribution", "uniform");
+	multiplicity_p = config.get_value<double>(group + ":multiplicity_p", 0.5);
+	if (multiplicity_distribution.compare("uniform") != 0 && multiplicity_distribution.compare("geometric") != 0) {
+		throw std::runtime_error("Unknown multiplicity distribution: " + multiplicity_distribution);
+	}
+	if (multiplicity_p <= 0 || multiplicity_p > 1) {
+		throw std::runtime_error("Parameter multiplicity_p must be in (0, 1].");
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+double WorkloadGenerator::draw_uniform() {
+	// 53 random bits fill the mantissa of a double
+	return (rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint WorkloadGenerator::draw_uniform(uint min, uint max) {
+	return min + static_cast<uint>(rng() % (static_cast<unsigned long long>(max) - min + 1));
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint WorkloadGenerator::draw_element() {
+	auto it = std::upper_bound(element_cdf.begin(), element_cdf.end(), draw_uniform());
+	return std::min<uint>(it - element_cdf.begin(), _alphabet - 1);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint WorkloadGenerator::draw_cardinality() {
+	if (cardinality_distribution.compare("normal") == 0) {
+		// Box-Muller transform, the range covers six standard deviations
+		double mean = (cardinality_min + cardinality_max) / 2.0;
+		double deviation = (cardinality_max - cardinality_min) / 6.0;
+		double z = std::sqrt(-2 * std::log(1 - draw_uniform())) * std::cos(2 * M_PI * draw_uniform());
+		double cardinality = std::round(mean + z * deviation);
+		return static_cast<uint>(std::min<double>(std::max<double>(cardinality, cardinality_min), cardinality_max));
+	}
+	return draw_uniform(cardinality_min, cardinality_max);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint WorkloadGenerator::draw_multiplicity() {
+	if (multiplicity_distribution.compare("geometric") == 0) {
+		if (multiplicity_p >= 1) return 1;
+		double m = 1 + std::floor(std::log(1 - draw_uniform()) / std::log(1 - multiplicity_p));
+		return static_cast<uint>(std::min<double>(m, _max_multiplicity));
+	}
+	return draw_uniform(1, std::max(1u, _max_multiplicity));
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void WorkloadGenerator::fill(std::vector<uint> &v, uint cardinality) {
+	uint total = 0;
+	for (auto m : v) total += m;
+	// popular elements are drawn repeatedly, the attempts are bounded
+	for (uint attempts = 0; total < cardinality && attempts < 16 * _alphabet; attempts++) {
+		uint element = draw_element();
+		if (v[element] > 0) continue;
+		v[element] = std::min(draw_multiplicity(), cardinality - total);
+		total += v[element];
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::vector<uint> WorkloadGenerator::generate() {
+	std::vector<uint> v (_alphabet, 0);
+	fill(v, std::min(draw_cardinality(), _alphabet * _max_multiplicity));
+	return v;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::vector<uint> WorkloadGenerator::extend(const std::vector<uint> &v) {
+	std::vector<uint> extended = v;
+	uint total = 0;
+	for (auto m : v) total += m;
+	uint extra = draw_uniform(1, std::max(1u, total / 4));
+	for (uint attempts = 0; extra > 0 && attempts < 16 * _alphabet; attempts++) {
+		uint element = draw_element();
+		if (extended[element] < _max_multiplicity) {
+			extended[element]++;
+			extra--;
+		}
+	}
+	return extended;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::vector<uint> WorkloadGenerator::reduce(const std::vector<uint> &v) {
+	std::vector<uint> reduced = v;
+	uint total = 0;
+	for (uint i = 0; i < _alphabet; i++) {
+		total += v[i];
+	}
+	if (total == 0) {
+		return reduced;
+	}
+	uint removed = draw_uniform(1, std::max(1u, total / 4));
+	for (uint i = 0; i < removed; i++) {
+		// every unit of multiplicity is removed with the same probability
+		uint unit = draw_uniform(0, total - i - 1);
+		for (uint element = 0; element < _alphabet; element++) {
+			if (unit < reduced[element]) {
+				reduced[element]--;
+				break;
+			}
+			unit -= reduced[element];
+		}
+	}
+	return reduced;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string WorkloadGenerator::to_string(const std::vector<uint> &v) {
+	std::string s;
+	for (uint i = 0; i < v.size(); i++) {
+		if (v[i] == 0) continue;
+		if (!s.empty()) s += ',';
+		s += std::to_string(i);
+		if (v[i] > 1) s += ':' + std::to_string(v[i]);
+	}
+	return s.empty() ? "*" : s;
+}
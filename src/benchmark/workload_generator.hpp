@@ -0,0 +1,66 @@
+//
+//  workload_generator.hpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#ifndef WORKLOAD_GENERATOR_HPP
+#define WORKLOAD_GENERATOR_HPP
+
+#include <random>
+#include <string>
+#include <vector>
+#include "../lib/configurator.hpp"
+
+
+/* Generator of synthetic multisets
+ *
+ * A multiset is generated by drawing its cardinality, then drawing
+ * distinct elements by their Zipfian popularity (element 0 is the most
+ * popular one) and a multiplicity for each of them until the cardinality
+ * is reached. Only the Mersenne Twister engine of the standard library
+ * is used, its raw output is the same everywhere, but the Zipfian, normal
+ * and geometric draws go through std::pow, std::log, std::sqrt and
+ * std::cos, whose last bits may differ between math libraries. A seed
+ * gives the same multisets with the same toolchain and libm, and with
+ * the uniform distributions and a zipf_exponent of 0 on any platform.
+ */
+class WorkloadGenerator {
+private:
+	const uint _alphabet;
+	const uint _max_multiplicity;
+
+	std::mt19937_64 rng;
+	// cumulative popularity of elements
+	std::vector<double> element_cdf;
+	std::string cardinality_distribution;
+	uint cardinality_min;
+	uint cardinality_max;
+	std::string multiplicity_distribution;
+	double multiplicity_p;
+
+	uint draw_element();
+	uint draw_cardinality();
+	uint draw_multiplicity();
+	// adds distinct elements with drawn multiplicities until the cardinality is reached
+	void fill(std::vector<uint> &v, uint cardinality);
+public:
+	// reads the generator parameters from configuration group
+	WorkloadGenerator(Configurator &config, const std::string &group, uint alphabet, uint max_multiplicity);
+
+	// uniform in [0, 1)
+	double draw_uniform();
+	// uniform in [min, max]
+	uint draw_uniform(uint min, uint max);
+
+	std::vector<uint> generate();
+	// a supermultiset of v with a few more elements
+	std::vector<uint> extend(const std::vector<uint> &v);
+	// a submultiset of v with a few elements removed
+	std::vector<uint> reduce(const std::vector<uint> &v);
+	// the multiset in element:multiplicity notation
+	static std::string to_string(const std::vector<uint> &v);
+};
+
+#endif /* WORKLOAD_GENERATOR_HPP */
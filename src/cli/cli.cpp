@@ -6,12 +6,21 @@
 //  Copyright © 2018 Mikita Akulich. All rights reserved.
 //
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <vector>
 #include <typeinfo>
+#include <fcntl.h>
+#include <unistd.h>
 #include "cli.hpp"
+#include "../core/query_trace.hpp"
+#include "../utils/file_utils.hpp"
 
 
 Cli::Cli(const Configurator &config, const std::string &default_manager_name) :
@@ -22,26 +31,61 @@ help_text("\nMstrie commands:\n"
 			"\t\t loads or creates a new Multiset-trie structure using configuration parameters\n"
 			"\t\t such as maximal allowed multiset multiplicity, maximal allowed multiset alphabet size\n"
 			"\t\t and file path for storage.\n"
+	"\n\t save\n"
+			"\t\t saves all Multiset-trie structures into configured files. If background checkpoints\n"
+			"\t\t are configured, the structures are saved in background and remain available.\n"
 	"\n\t flush\n"
 			"\t\t saves the Multiset-trie structure into configured file and destroys the instance.\n"
 	"\n\t search < <= | = | >= > <word>\n"
 			"\t\t gives an answer wheather there is a matching found similar to word. The type\n"
 			"\t\t of matching can be specified: '=' - exact matching; '<=' - submultiset matching;\n"
 			"\t\t '>=' - supermultiset matching.\n"
-	"\n\t retrieve < <= | >= > <word | *> [limit]\n"
+	"\n\t retrieve < <= | >= > <word | *> [limit [min_cardinality [max_cardinality]]]\n"
 			"\t\t retrieves the matched results similar to word or * = empty string. The type of\n"
 			"\t\t matching can be specified: '<=' - submultiset matching; '>=' - supermultiset matching.\n"
 			"\t\t The limit parameter sets the offset limit for the multiplicity changes during search.\n"
+			"\t\t Only the multisets with at least min_cardinality and at most max_cardinality elements\n"
+			"\t\t are retrieved, a limit, a min_cardinality or a max_cardinality of -1 means none.\n"
+	"\n\t retrieve_maximal <= <word | *> [limit]\n"
+			"\t\t retrieves the results of 'retrieve <=' that are not a submultiset of another result.\n"
+	"\n\t retrieve_minimal >= <word | *> [limit]\n"
+			"\t\t retrieves the results of 'retrieve >=' that are not a supermultiset of another result.\n"
+	"\n\t within < ~ | <= | >= > <word | *> <distance>\n"
+			"\t\t retrieves the multisets within the total distance from word, the sum of the\n"
+			"\t\t differences of the multiplicities over all elements: '~' - in both directions;\n"
+			"\t\t '<=' - submultisets with at most distance elements less; '>=' - supermultisets\n"
+			"\t\t with at most distance elements more.\n"
+	"\n\t nearest <word | *> <k> [weights]\n"
+			"\t\t retrieves the k multisets nearest to word by the L1 distance, the sum of the\n"
+			"\t\t differences of the multiplicities, nearest first and with their distance. The weights\n"
+			"\t\t are a comma-separated weight of every element of the alphabet, each difference is\n"
+			"\t\t multiplied by the weight of its element.\n"
 	"\n\t update < - | + > <word>\n"
 			"\t\t update the Multiset-trie structure with word. The types of update: '-' - word removal;\n"
 			"\t\t '+' - word insertion.\n"
 	"\n\t stats_<all | total | last>\n"
 			"\t\t print statistics of the Multiset-trie structure. All - print both total and last\n"
 			"\t\t statistics; total - print the total number of nodes and the total number of multisets\n"
-			"\t\t in Multiset-trie; last - print the name, the time and the number of nodes traversed for\n"
-			"\t\t the last performed query.\n"
+			"\t\t in Multiset-trie, the memory taken by the nodes with breakdown per level and the number\n"
+			"\t\t of nodes by their number of children; last - print the name, the time and the number of\n"
+			"\t\t nodes traversed for the last performed query.\n"
+	"\n\t stats_checkpoint\n"
+			"\t\t print the progress and the duration of the running or the last checkpoint.\n"
+	"\n\t stats_cache\n"
+			"\t\t print the number of entries and the bytes of the query result cache, its hits,\n"
+			"\t\t misses and the entries evicted for the budget or invalidated by updates.\n"
+	"\n\t stats_profile\n"
+			"\t\t print the number of visited nodes, of branches skipped because of the limit and of\n"
+			"\t\t nodes without results per level for the last performed query, and the number of\n"
+			"\t\t results. Requires the program to be configured with --enable-profile.\n"
+	"\n\t trace < start [capacity] | stop | export <file> >\n"
+			"\t\t records the time spent in parsing, traversal, formatting and printing of every query.\n"
+			"\t\t Start drops the recorded spans and keeps at most capacity spans per thread; export\n"
+			"\t\t writes the spans as Chrome trace events, to be opened in chrome://tracing or Perfetto.\n"
 	"\n\t exit\n"
-			"\t\t perform flush command and exit the mstrie program.\n"),
+			"\t\t perform flush command and exit the mstrie program.\n"
+	"\nA word is a comma-separated list of elements, e.g. 0,3,3,3. An element can be followed\n"
+	"by its multiplicity, e.g. 0,3:3.\n"),
 f_mapper(std::map<std::string, std::function<void(Cli&, const std::vector<std::string>&)> > {
 	{"help",				Cli::Tasks::display_help},
 	{"configure",		Cli::Tasks::manager_configure},
@@ -52,15 +96,51 @@ f_mapper(std::map<std::string, std::function<void(Cli&, const std::vector<std::s
 	{"search",			Cli::Tasks::search_query},
 	{"update",			Cli::Tasks::update_query},
 	{"retrieve",		Cli::Tasks::retrieve_query},
+	{"retrieve_maximal",	Cli::Tasks::retrieve_maximal_query},
+	{"retrieve_minimal",	Cli::Tasks::retrieve_minimal_query},
+	{"within",			Cli::Tasks::within_query},
+	{"nearest",			Cli::Tasks::nearest_query},
 	{"stats_all",		Cli::Tasks::stats_full},
 	{"stats_total",	Cli::Tasks::stats_total},
-	{"stats_last",	Cli::Tasks::stats_last}
+	{"stats_last",	Cli::Tasks::stats_last},
+	{"stats_checkpoint",	Cli::Tasks::stats_checkpoint},
+	{"stats_cache",	Cli::Tasks::stats_cache},
+	{"stats_profile",	Cli::Tasks::stats_profile},
+	{"trace",				Cli::Tasks::trace}
 }),
 default_manager(default_manager_name) {
 	this->current_manager = "";
 	this->manager = std::map<std::string, std::unique_ptr<MstrieManager>>();
 	this->do_loop = true;
 	this->config = std::make_unique<Configurator>(config);
+	this->batch = false;
+	this->output_fd = -1;
+	this->output_block = 0;
+	this->line = 0;
+	this->commands = 0;
+	this->updates = 0;
+	this->queries = 0;
+	this->errors = 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+CliBatchSettings::CliBatchSettings(const std::string &input, const std::string &output, size_t block_size, uint group_size)
+: input(input),
+output(output),
+block_size(block_size),
+group_size(group_size) {
+}
+
+// -----------------------------------------------------------------------------------------------
+
+CliBatchSettings CliBatchSettings::from_config(Configurator &config) {
+	return CliBatchSettings(
+		config.get_value<std::string>("batch:input", "-"),
+		config.get_value<std::string>("batch:output", "-"),
+		std::max<size_t>(1 << 12, config.get_value<size_t>("batch:block_size", 1 << 20)),
+		config.get_value<uint>("batch:group_size", 0)
+	);
 }
 
 // -----------------------------------------------------------------------------------------------
@@ -123,12 +203,20 @@ void Cli::exec_task(const std::vector<std::string> &command){
 // -----------------------------------------------------------------------------------------------
 
 void Cli::print_message(const std::string &message){
-	std::cout<<message<<std::endl;
+	if (batch) {
+		output += message;
+		output += '\n';
+		if (output.size() >= output_block) flush_output();
+	}
+	else {
+		std::cout<<message<<std::endl;
+	}
 }
 
 // -----------------------------------------------------------------------------------------------
 
 void Cli::print_exception(std::exception &e, int level){
+	if (batch && level == 0) std::cerr<<"line "<<line<<": ";
 	std::cerr<<std::string(level, ' ')<<"error: "<<e.what()<<std::endl;
 	try {
 		std::rethrow_if_nested(e);
@@ -142,6 +230,170 @@ void Cli::print_exception(std::exception &e, int level){
 // ===============================================================================================
 // ===============================================================================================
 
+/* ------------------------------------------------------------------
+ * Batch mode
+ * ------------------------------------------------------------------
+ */
+void Cli::batch_loop(const CliBatchSettings &settings) {
+	int input_fd = 0;
+	if (settings.input.compare("-") != 0) {
+		input_fd = open(settings.input.c_str(), O_RDONLY);
+		if (input_fd < 0) {
+			throw std::runtime_error("Batch input " + settings.input + " can't be opened: " + strerror(errno));
+		}
+	}
+	output_fd = 1;
+	if (settings.output.compare("-") != 0) {
+		output_fd = open(settings.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (output_fd < 0) {
+			if (input_fd != 0) close(input_fd);
+			throw std::runtime_error("Batch output " + settings.output + " can't be opened: " + strerror(errno));
+		}
+	}
+	batch = true;
+	output_block = settings.block_size;
+	output.reserve(output_block + (1 << 12));
+	auto tp_start = std::chrono::steady_clock::now();
+	
+	try {
+		// the default Multiset-trie is ready without a configure command
+		line = 0;
+		Tasks::manager_configure(*this, std::vector<std::string>{ "configure" });
+		
+		std::string data;
+		std::vector<char> block(settings.block_size);
+		std::vector<std::string> argv;
+		bool end_of_input = false;
+		while (do_loop && !end_of_input) {
+			ssize_t n = read(input_fd, block.data(), block.size());
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				throw std::runtime_error("Batch input " + settings.input + " can't be read: " + strerror(errno));
+			}
+			if (n == 0) {
+				// the last line may have no line break
+				end_of_input = true;
+				if (!data.empty()) data += '\n';
+			}
+			data.append(block.data(), n);
+			
+			const char *begin = data.data();
+			const char *end = begin + data.size();
+			const char *p = begin;
+			while (do_loop) {
+				const char *line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+				if (line_end == nullptr) break;
+				line++;
+				// split the line into arguments at blanks
+				argv.clear();
+				const char *q = p;
+				while (q < line_end) {
+					while (q < line_end && (*q == ' ' || *q == '\t' || *q == '\r')) q++;
+					const char *arg = q;
+					while (q < line_end && *q != ' ' && *q != '\t' && *q != '\r') q++;
+					if (q > arg) argv.emplace_back(arg, q);
+				}
+				p = line_end + 1;
+				if (!argv.empty()) run_batch_command(argv, settings.group_size);
+			}
+			data.erase(0, p - begin);
+		}
+		run_update_group();
+		if (do_loop) Tasks::exit(*this, std::vector<std::string>{ "exit" });
+		flush_output();
+	} catch (std::exception &e) {
+		batch = false;
+		if (input_fd != 0) close(input_fd);
+		if (output_fd != 1) close(output_fd);
+		throw;
+	}
+	batch = false;
+	if (input_fd != 0) close(input_fd);
+	if (output_fd != 1) close(output_fd);
+	
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tp_start).count();
+	std::cerr<<"Batch: "<<commands<<" commands ("<<updates<<" updates, "<<queries<<" queries, "<<errors<<" errors) in "
+		<<seconds<<" s, "<<static_cast<unsigned long>(seconds > 0 ? commands / seconds : 0)<<" commands/s"<<std::endl;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Cli::run_batch_command(const std::vector<std::string> &argv, uint group_size) {
+	commands++;
+	const std::string &name = argv[0];
+	bool update = name.compare("update") == 0;
+	if (update) updates++;
+	else if (name.compare("search") == 0 || name.compare("retrieve") == 0
+		|| name.compare("retrieve_maximal") == 0 || name.compare("retrieve_minimal") == 0
+		|| name.compare("within") == 0 || name.compare("nearest") == 0) queries++;
+	
+	auto current = manager.find(current_manager);
+	if (update && group_size > 1 && argv.size() == 3 && current != manager.end() && current->second != nullptr && current->second->index_exists()) {
+		update_group.emplace_back(argv[1], argv[2]);
+		update_group_lines.push_back(line);
+		if (update_group.size() >= group_size) run_update_group();
+		return;
+	}
+	// the commands run in the order of the input
+	run_update_group();
+	auto task = f_mapper.find(name);
+	try {
+		if (task == f_mapper.end()) {
+			throw std::runtime_error("Unknown command: " + name);
+		}
+		task->second(*this, argv);
+	} catch (std::exception &e) {
+		errors++;
+		print_exception(e);
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Cli::run_update_group() {
+	if (update_group.empty()) return;
+	unsigned long command_line = line;
+	std::vector<std::string> group_errors;
+	try {
+		TraceSpan span("query");
+		manager.at(current_manager)->update_batch(update_group, group_errors);
+	} catch (std::exception &e) {
+		errors++;
+		print_exception(e);
+	}
+	for (size_t i = 0; i < group_errors.size(); i++) {
+		if (group_errors[i].empty()) continue;
+		errors++;
+		line = update_group_lines[i];
+		std::runtime_error e(group_errors[i]);
+		print_exception(e);
+	}
+	line = command_line;
+	update_group.clear();
+	update_group_lines.clear();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Cli::flush_output() {
+	const char *data = output.data();
+	size_t left = output.size();
+	while (left > 0) {
+		ssize_t written = write(output_fd, data, left);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			output.clear();
+			throw std::runtime_error(std::string("Batch output can't be written: ") + strerror(errno));
+		}
+		data += written;
+		left -= written;
+	}
+	output.clear();
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
 /* ------------------------------------------------------------------
  * Tasks for configuration and destuction
  * ------------------------------------------------------------------
@@ -169,12 +421,7 @@ void Cli::Tasks::manager_configure(Cli &cli, const std::vector<std::string> &arg
 			cli.current_manager = manager_name;
 		}
 		else {
-			MstrieSettings settings = MstrieSettings(
-																							 cli.config->get_value<uint>(manager_name + ":alphabet_length"),
-																							 cli.config->get_value<uint>(manager_name + ":max_multiplicity"),
-																							 cli.config->get_value<std::string>(manager_name + ":mstrie_path")
-																							 );
-			cli.manager.at(manager_name) = std::make_unique<MstrieManager>(settings);
+			cli.manager.at(manager_name) = MstrieManager::from_config(*cli.config, manager_name);
 			try {
 				cli.manager.at(manager_name)->init_index();
 			} catch (std::exception &e) {
@@ -284,6 +531,7 @@ void Cli::Tasks::display_help(Cli &cli, const std::vector<std::string> &argv) {
  * ------------------------------------------------------------------
  */
 void Cli::Tasks::search_query(Cli &cli, const std::vector<std::string> &argv){
+	TraceSpan span("query");
 	try {
 		if (cli.manager.at(cli.current_manager) != nullptr && cli.manager.at(cli.current_manager)->index_exists()){
 			bool result;
@@ -297,6 +545,7 @@ void Cli::Tasks::search_query(Cli &cli, const std::vector<std::string> &argv){
 				throw std::runtime_error("Unexpected number of arguments, 2 expected");
 			}
 			// print result
+			TraceSpan io_span("io");
 			if (result) {
 				cli.print_message("Found match to "+ argv[2]);
 			}
@@ -315,6 +564,7 @@ void Cli::Tasks::search_query(Cli &cli, const std::vector<std::string> &argv){
 // -----------------------------------------------------------------------------------------------
 
 void Cli::Tasks::update_query(Cli &cli, const std::vector<std::string> &argv){
+	TraceSpan span("query");
 	try {
 		if (cli.manager.at(cli.current_manager) != nullptr && cli.manager.at(cli.current_manager)->index_exists()){
 			if (argv.size() == 3) {
@@ -335,18 +585,126 @@ void Cli::Tasks::update_query(Cli &cli, const std::vector<std::string> &argv){
 // -----------------------------------------------------------------------------------------------
 
 void Cli::Tasks::retrieve_query(Cli &cli, const std::vector<std::string> &argv){
+	TraceSpan span("query");
 	try {
 		if (cli.manager.at(cli.current_manager) != nullptr && cli.manager.at(cli.current_manager)->index_exists()){
 			std::string q_out;
-			if (argv.size() == 4) { // the limit is specified
+			if (argv.size() == 5 || argv.size() == 6) { // the cardinality bounds are specified
+				// -1 means no bound, as for the limit
+				int min_cardinality = std::stoi(argv[4]);
+				if (min_cardinality < -1) {
+					throw std::runtime_error("Unexpected min_cardinality " + argv[4] + ", -1 or a non-negative number expected");
+				}
+				int max_cardinality = argv.size() == 6 ? std::stoi(argv[5]) : -1;
+				q_out = cli.manager.at(cli.current_manager)->retrieve_query(argv[1], argv[2], std::stoi(argv[3]), std::max(min_cardinality, 0), max_cardinality);
+			}
+			else if (argv.size() == 4) { // the limit is specified
 				q_out = cli.manager.at(cli.current_manager)->retrieve_query(argv[1], argv[2], std::stoi(argv[3]));
 			}
 			else if (argv.size() == 3) { // the limit is ommited
 				q_out = cli.manager.at(cli.current_manager)->retrieve_query(argv[1], argv[2]);
 			}
+			else {
+				throw std::runtime_error("Unexpected number of arguments, 2 to 5 expected");
+			}
+			TraceSpan io_span("io");
+			cli.print_message(q_out);
+		}
+		else {
+			cli.print_message("Index does not exist.");
+		}
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Cli::Tasks::retrieve_maximal_query(Cli &cli, const std::vector<std::string> &argv){
+	if (argv.size() >= 2 && argv[1].compare("<=") != 0) {
+		throw std::runtime_error("Maximal multisets are retrieved only for '<='");
+	}
+	retrieve_extremal_query(cli, argv);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Cli::Tasks::retrieve_minimal_query(Cli &cli, const std::vector<std::string> &argv){
+	if (argv.size() >= 2 && argv[1].compare(">=") != 0) {
+		throw std::runtime_error("Minimal multisets are retrieved only for '>='");
+	}
+	retrieve_extremal_query(cli, argv);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Cli::Tasks::retrieve_extremal_query(Cli &cli, const std::vector<std::string> &argv){
+	TraceSpan span("query");
+	try {
+		if (cli.manager.at(cli.current_manager) != nullptr && cli.manager.at(cli.current_manager)->index_exists()){
+			std::string q_out;
+			if (argv.size() == 4) { // the limit is specified
+				q_out = cli.manager.at(cli.current_manager)->retrieve_extremal_query(argv[1], argv[2], std::stoi(argv[3]));
+			}
+			else if (argv.size() == 3) { // the limit is ommited
+				q_out = cli.manager.at(cli.current_manager)->retrieve_extremal_query(argv[1], argv[2]);
+			}
 			else {
 				throw std::runtime_error("Unexpected number of arguments, 2 or 3 expected");
 			}
+			TraceSpan io_span("io");
+			cli.print_message(q_out);
+		}
+		else {
+			cli.print_message("Index does not exist.");
+		}
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Cli::Tasks::within_query(Cli &cli, const std::vector<std::string> &argv){
+	TraceSpan span("query");
+	try {
+		if (cli.manager.at(cli.current_manager) != nullptr && cli.manager.at(cli.current_manager)->index_exists()){
+			if (argv.size() != 4) {
+				throw std::runtime_error("Unexpected number of arguments, 3 expected");
+			}
+			long long distance = std::stoll(argv[3]);
+			if (distance < 0 || distance > UINT_MAX) {
+				throw std::runtime_error("Unexpected distance " + argv[3] + ", a non-negative number expected");
+			}
+			std::string q_out = cli.manager.at(cli.current_manager)->within_query(argv[1], argv[2], static_cast<uint>(distance));
+			TraceSpan io_span("io");
+			cli.print_message(q_out);
+		}
+		else {
+			cli.print_message("Index does not exist.");
+		}
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Cli::Tasks::nearest_query(Cli &cli, const std::vector<std::string> &argv){
+	TraceSpan span("query");
+	try {
+		if (cli.manager.at(cli.current_manager) != nullptr && cli.manager.at(cli.current_manager)->index_exists()){
+			std::string q_out;
+			if (argv.size() == 4) { // the weights are specified
+				q_out = cli.manager.at(cli.current_manager)->nearest_query(argv[1], std::stoul(argv[2]), argv[3]);
+			}
+			else if (argv.size() == 3) {
+				q_out = cli.manager.at(cli.current_manager)->nearest_query(argv[1], std::stoul(argv[2]));
+			}
+			else {
+				throw std::runtime_error("Unexpected number of arguments, 2 or 3 expected");
+			}
+			TraceSpan io_span("io");
 			cli.print_message(q_out);
 		}
 		else {
@@ -395,3 +753,68 @@ void Cli::Tasks::stats_last(Cli &cli, const std::vector<std::string> &argv){
 	}
 }
 
+// -----------------------------------------------------------------------------------------------
+
+void Cli::Tasks::stats_checkpoint(Cli &cli, const std::vector<std::string> &argv){
+	if (cli.manager.at(cli.current_manager) != nullptr && cli.manager.at(cli.current_manager)->index_exists()){
+		cli.print_message(cli.manager.at(cli.current_manager)->print_checkpoint_stats());
+	}
+	else {
+		cli.print_message("Index does not exist.");
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Cli::Tasks::stats_cache(Cli &cli, const std::vector<std::string> &argv){
+	if (cli.manager.at(cli.current_manager) != nullptr && cli.manager.at(cli.current_manager)->index_exists()){
+		cli.print_message(cli.manager.at(cli.current_manager)->print_cache_stats());
+	}
+	else {
+		cli.print_message("Index does not exist.");
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Cli::Tasks::stats_profile(Cli &cli, const std::vector<std::string> &argv){
+	if (cli.manager.at(cli.current_manager) != nullptr && cli.manager.at(cli.current_manager)->index_exists()){
+		cli.print_message(cli.manager.at(cli.current_manager)->print_profile_stats());
+	}
+	else {
+		cli.print_message("Index does not exist.");
+	}
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+/* ------------------------------------------------------------------
+ * Tasks for tracing
+ * ------------------------------------------------------------------
+ */
+void Cli::Tasks::trace(Cli &cli, const std::vector<std::string> &argv){
+	try {
+		if (argv.size() >= 2 && argv[1].compare("start") == 0 && argv.size() <= 3) {
+			size_t capacity = argv.size() == 3 ? std::stoul(argv[2]) : QueryTrace::default_capacity;
+			if (capacity == 0) {
+				throw std::runtime_error("Trace capacity must be positive.");
+			}
+			QueryTrace::start(capacity);
+			cli.print_message("Tracing started.");
+		}
+		else if (argv.size() == 2 && argv[1].compare("stop") == 0) {
+			QueryTrace::stop();
+			cli.print_message("Tracing stopped, " + std::to_string(QueryTrace::size()) + " spans recorded.");
+		}
+		else if (argv.size() == 3 && argv[1].compare("export") == 0) {
+			FileUtils::write_file(argv[2], QueryTrace::export_json());
+			cli.print_message("Exported " + std::to_string(QueryTrace::size()) + " spans to " + argv[2] + ".");
+		}
+		else {
+			throw std::runtime_error("Unexpected arguments, expected: trace < start [capacity] | stop | export <file> >");
+		}
+	} catch (std::exception &e) {
+		throw;
+	}
+}
@@ -15,6 +15,22 @@
 #include "../lib/configurator.hpp"
 
 
+/* Settings of the batch mode, configured in the group "batch" */
+class CliBatchSettings {
+public:
+	// file with commands, one per line, "-" - standard input
+	std::string input;
+	// file the results are written to, "-" - standard output
+	std::string output;
+	// bytes read and written at once
+	size_t block_size;
+	// consecutive updates of the current Multiset-trie committed together, 0 or 1 - one at a time
+	uint group_size;
+	
+	CliBatchSettings(const std::string &input = "-", const std::string &output = "-", size_t block_size = 1 << 20, uint group_size = 0);
+	static CliBatchSettings from_config(Configurator &config);
+};
+
 class Cli {
 private:
 	// config
@@ -41,18 +57,50 @@ private:
 		static void search_query(Cli &cli, const std::vector<std::string> &argv);
 		static void update_query(Cli &cli, const std::vector<std::string> &argv);
 		static void retrieve_query(Cli &cli, const std::vector<std::string> &argv);
+		static void retrieve_maximal_query(Cli &cli, const std::vector<std::string> &argv);
+		static void retrieve_minimal_query(Cli &cli, const std::vector<std::string> &argv);
+		// retrieve_maximal and retrieve_minimal once their query type is checked
+		static void retrieve_extremal_query(Cli &cli, const std::vector<std::string> &argv);
+		static void within_query(Cli &cli, const std::vector<std::string> &argv);
+		static void nearest_query(Cli &cli, const std::vector<std::string> &argv);
 		static void stats_full(Cli &cli, const std::vector<std::string> &argv);
 		static void stats_total(Cli &cli, const std::vector<std::string> &argv);
 		static void stats_last(Cli &cli, const std::vector<std::string> &argv);
+		static void stats_checkpoint(Cli &cli, const std::vector<std::string> &argv);
+		static void stats_cache(Cli &cli, const std::vector<std::string> &argv);
+		static void stats_profile(Cli &cli, const std::vector<std::string> &argv);
+		static void trace(Cli &cli, const std::vector<std::string> &argv);
 		static void display_help(Cli &cli, const std::vector<std::string> &argv);
 	};
 	
+	// batch mode, the messages are collected in output and written in blocks
+	bool batch;
+	std::string output;
+	int output_fd;
+	size_t output_block;
+	// line of the command being run in batch mode
+	unsigned long line;
+	// commands of the batch mode
+	unsigned long commands;
+	unsigned long updates;
+	unsigned long queries;
+	unsigned long errors;
+	std::vector<std::pair<std::string, std::string>> update_group;
+	std::vector<unsigned long> update_group_lines;
+	
+	void run_batch_command(const std::vector<std::string> &argv, uint group_size);
+	void run_update_group();
+	void flush_output();
+	
 	// utilities
 	void print_message(const std::string &message);
 	void print_exception(std::exception &e, int level = 0);
 public:
 	Cli(const Configurator &config, const std::string &default_manager_name);
 	void command_loop();
+	// runs the commands of the input without a prompt until its end or the exit command,
+	// then saves the Multiset-tries and reports the throughput on the standard error
+	void batch_loop(const CliBatchSettings &settings);
 };
 
 #endif /* CLI_HPP */
@@ -0,0 +1,161 @@
+//
+//  hash_index.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "hash_index.hpp"
+
+
+MstrieHashIndex::MstrieHashIndex(uint alphabet, uint max_multiplicity)
+: alphabet(alphabet),
+max_multiplicity(max_multiplicity),
+width(max_multiplicity <= UINT8_MAX ? 1 : (max_multiplicity <= UINT16_MAX ? 2 : 4)),
+slots(16, Slot{ 0, empty }),
+used(0) {
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint64_t MstrieHashIndex::fingerprint(const uint *v) const {
+	for (uint i = 0; i < alphabet; i++) {
+		if (v[i] > max_multiplicity) {
+			throw std::out_of_range("multiplicity " + std::to_string(v[i]) + " is above " + std::to_string(max_multiplicity));
+		}
+	}
+	return hash(v, alphabet);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint64_t MstrieHashIndex::hash(const uint *v, uint alphabet) {
+	uint64_t h = alphabet;
+	for (uint i = 0; i < alphabet; i++) {
+		h = (h ^ v[i]) * 0x9E3779B97F4A7C15ull;
+		h ^= h >> 32;
+	}
+	// the finalizer of splitmix64
+	h ^= h >> 30;
+	h *= 0xBF58476D1CE4E5B9ull;
+	h ^= h >> 27;
+	h *= 0x94D049BB133111EBull;
+	h ^= h >> 31;
+	return h;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieHashIndex::matches(uint32_t record, const uint *v) const {
+	const uint8_t *data = records.data() + static_cast<size_t>(record) * alphabet * width;
+	if (width == 1) {
+		for (uint i = 0; i < alphabet; i++) {
+			if (data[i] != v[i]) return false;
+		}
+		return true;
+	}
+	for (uint i = 0; i < alphabet; i++) {
+		uint32_t m = 0;
+		memcpy(&m, data + i * width, width);
+		if (m != v[i]) return false;
+	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+size_t MstrieHashIndex::find(uint64_t fingerprint, const uint *v) const {
+	size_t mask = slots.size() - 1;
+	size_t i = fingerprint & mask;
+	while (slots[i].record != empty) {
+		if (slots[i].fingerprint == fingerprint && matches(slots[i].record, v)) return i;
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieHashIndex::contains(const uint *v) const {
+	return slots[find(fingerprint(v), v)].record != empty;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieHashIndex::insert(const uint *v) {
+	uint64_t h = fingerprint(v);
+	// at most 70% of the slots are taken, so the probes stay short
+	if ((used + 1) * 10 > slots.size() * 7) grow();
+	uint32_t record;
+	if (!free_records.empty()) {
+		record = free_records.back();
+		free_records.pop_back();
+	}
+	else {
+		record = static_cast<uint32_t>(records.size() / (alphabet * width));
+		records.resize(records.size() + alphabet * width);
+	}
+	uint8_t *data = records.data() + static_cast<size_t>(record) * alphabet * width;
+	for (uint i = 0; i < alphabet; i++) {
+		uint32_t m = v[i];
+		if (width == 1) data[i] = static_cast<uint8_t>(m);
+		else memcpy(data + i * width, &m, width);
+	}
+	size_t mask = slots.size() - 1;
+	size_t i = h & mask;
+	while (slots[i].record != empty) i = (i + 1) & mask;
+	slots[i] = Slot{ h, record };
+	used++;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieHashIndex::erase(const uint *v) {
+	size_t i = find(fingerprint(v), v);
+	if (slots[i].record == empty) return;
+	free_records.push_back(slots[i].record);
+	used--;
+	// move back the following slots that would not be found past the hole
+	size_t mask = slots.size() - 1;
+	size_t j = i;
+	while (true) {
+		j = (j + 1) & mask;
+		if (slots[j].record == empty) break;
+		size_t home = slots[j].fingerprint & mask;
+		bool movable = (j > i) ? (home <= i || home > j) : (home <= i && home > j);
+		if (movable) {
+			slots[i] = slots[j];
+			i = j;
+		}
+	}
+	slots[i].record = empty;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieHashIndex::grow() {
+	std::vector<Slot> old(slots.size() * 2, Slot{ 0, empty });
+	old.swap(slots);
+	size_t mask = slots.size() - 1;
+	for (auto &slot : old) {
+		if (slot.record == empty) continue;
+		size_t i = slot.fingerprint & mask;
+		while (slots[i].record != empty) i = (i + 1) & mask;
+		slots[i] = slot;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+size_t MstrieHashIndex::size() const {
+	return used;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+unsigned long MstrieHashIndex::memory_bytes() const {
+	return slots.capacity() * sizeof(Slot) + records.capacity() + free_records.capacity() * sizeof(uint32_t);
+}
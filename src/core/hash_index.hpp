@@ -0,0 +1,65 @@
+//
+//  hash_index.hpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#ifndef HASH_INDEX_HPP
+#define HASH_INDEX_HPP
+
+#include <cstdint>
+#include <vector>
+
+
+/* Hash table of the stored multisets for exact search
+ *
+ * A slot holds the 64-bit fingerprint of a multiset and the number of its
+ * record, where the multiplicities are packed in one byte each (two or
+ * four bytes for a larger max multiplicity). A lookup compares the record
+ * as well, so a fingerprint collision does not give a wrong answer.
+ * Collisions are resolved by linear probing, and a deletion shifts the
+ * following slots back instead of leaving a tombstone.
+ */
+class MstrieHashIndex {
+private:
+	class Slot {
+	public:
+		uint64_t fingerprint;
+		uint32_t record;
+	};
+	static const uint32_t empty = UINT32_MAX;
+	
+	const uint alphabet;
+	const uint max_multiplicity;
+	// bytes per multiplicity in a record
+	const uint width;
+	
+	// the number of slots is a power of two
+	std::vector<Slot> slots;
+	size_t used;
+	std::vector<uint8_t> records;
+	// records of deleted multisets, reused by insertions
+	std::vector<uint32_t> free_records;
+	
+	// throws if a multiplicity is above max_multiplicity
+	uint64_t fingerprint(const uint *v) const;
+	bool matches(uint32_t record, const uint *v) const;
+	// slot of the multiset, or the empty slot it would take
+	size_t find(uint64_t fingerprint, const uint *v) const;
+	void grow();
+public:
+	MstrieHashIndex(uint alphabet, uint max_multiplicity);
+	
+	// 64-bit hash of a multiplicity vector, the low bits are as good as the high ones
+	static uint64_t hash(const uint *v, uint alphabet);
+	bool contains(const uint *v) const;
+	// the multiset must not be in the index
+	void insert(const uint *v);
+	// nothing happens if the multiset is not in the index
+	void erase(const uint *v);
+	size_t size() const;
+	unsigned long memory_bytes() const;
+};
+
+#endif /* HASH_INDEX_HPP */
@@ -15,9 +15,62 @@
 #include "../utils/file_utils.hpp"
 
 
-MstrieManager::MstrieManager(const MstrieSettings &settings) {
+MstrieManager::MstrieManager(const MstrieSettings &settings, const MstrieWalSettings &wal_settings, bool background_checkpoint)
+: background_checkpoint(background_checkpoint) {
 	this->mstrie = nullptr;
+	this->wal = nullptr;
 	this->settings = std::make_unique<MstrieSettings>(settings);
+	this->wal_settings = std::make_unique<MstrieWalSettings>(wal_settings);
+	this->checkpoint_progress = std::make_shared<MstrieCheckpointProgress>();
+	this->load_threads = 0;
+	this->cache_bytes = 0;
+	this->cache = nullptr;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+MstrieManager::~MstrieManager() {
+	// the checkpoint thread reads the mstrie structure
+	if (checkpoint_task.valid()) {
+		checkpoint_task.wait();
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+MstrieCheckpointProgress::MstrieCheckpointProgress() {
+	running = false;
+	multisets_written = 0;
+	multisets_total = 0;
+	time_taken = -1;
+	error = "";
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::unique_ptr<MstrieManager> MstrieManager::from_config(Configurator &config, const std::string &mstrie_name, const std::string &default_statistics) {
+	MstrieSettings settings = MstrieSettings(
+																					 config.get_value<uint>(mstrie_name + ":alphabet_length"),
+																					 config.get_value<uint>(mstrie_name + ":max_multiplicity"),
+																					 config.get_value<std::string>(mstrie_name + ":mstrie_path"),
+																					 config.get_value<uint>(mstrie_name + ":run_length_notation", 0) != 0,
+																					 config.get_value<uint>(mstrie_name + ":compressed_format", 0) != 0,
+																					 MstrieSettings::parse_statistics_level(config.get_value<std::string>(mstrie_name + ":statistics", default_statistics)),
+																					 config.get_value<uint>(mstrie_name + ":hash_index", 0) != 0,
+																					 config.get_value<uint>(mstrie_name + ":membership_filter", 0) != 0 ? config.get_value<double>(mstrie_name + ":filter_false_positive_rate", 0.01) : 0
+																					 );
+	MstrieWalSettings wal_settings = MstrieWalSettings(
+																										 config.get_value<uint>(mstrie_name + ":wal_enabled", 0) != 0,
+																										 MstrieWalSettings::parse_sync_policy(config.get_value<std::string>(mstrie_name + ":wal_sync", "group")),
+																										 config.get_value<uint>(mstrie_name + ":wal_group_size", 64),
+																										 config.get_value<uint>(mstrie_name + ":wal_checkpoint_interval", 0),
+																										 config.get_value<uint>(mstrie_name + ":wal_group_delay_ms", 10)
+																										 );
+	bool background_checkpoint = config.get_value<uint>(mstrie_name + ":background_checkpoint", 0) != 0;
+	auto manager = std::make_unique<MstrieManager>(settings, wal_settings, background_checkpoint);
+	manager->load_threads = config.get_value<uint>(mstrie_name + ":load_threads", 0);
+	manager->cache_bytes = config.get_value<size_t>(mstrie_name + ":cache_bytes", 0);
+	return manager;
 }
 
 // ===============================================================================================
@@ -36,12 +89,26 @@ void MstrieManager::init_index() {
 void MstrieManager::create_index() {
 	try {
 		mstrie = std::make_unique<MstrieStructure>(*settings);
-		if (FileUtils::file_exists(settings->index_path)) {
-			mstrie->load_mstrie(FileUtils::read_from_file(settings->index_path));
+		cache = cache_bytes > 0 ? std::make_unique<MstrieQueryCache>(cache_bytes) : nullptr;
+		bool index_file_exists = FileUtils::file_exists(settings->index_path);
+		unsigned long long checkpoint_lsn = 0;
+		if (index_file_exists) {
+			FileUtils::MappedFile index_file(settings->index_path);
+			restore_filter(index_file.data(), index_file.size());
+			checkpoint_lsn = mstrie->load_mstrie(index_file.data(), index_file.size(), load_threads);
 		}
-		else
+		if (wal_settings->enabled) {
+			// bring the index up to date with updates made after the checkpoint
+			wal = std::make_unique<MstrieWal>(settings->index_path + ".wal", *wal_settings);
+			auto last_lsn = wal->replay(checkpoint_lsn, [this](const std::string &query_type, const std::string &word) {
+				apply_update(query_type, word);
+			});
+			wal->open(last_lsn);
+		}
+		if (!index_file_exists)
 			save_index();
 	} catch (std::exception &e) {
+		wal = nullptr;
 		mstrie = nullptr;
 		throw;
 	}
@@ -51,7 +118,22 @@ void MstrieManager::create_index() {
 
 void MstrieManager::save_index() {
 	try {
-		FileUtils::write_file(settings->index_path, mstrie->retrieve_mstrie());
+		wait_checkpoint();
+		auto filter = mstrie->copy_filter();
+		std::string content;
+		if (wal != nullptr) {
+			// the checkpoint covers every record, so the log can be dropped once it is persisted
+			content = mstrie->retrieve_mstrie(wal->last_lsn());
+			FileUtils::replace_file(settings->index_path, content);
+			wal->reset();
+		}
+		else {
+			content = mstrie->retrieve_mstrie();
+			FileUtils::write_file(settings->index_path, content);
+		}
+		if (filter != nullptr) {
+			save_filter(settings->index_path, *filter, content);
+		}
 	} catch (std::exception &e) {
 		throw;
 	}
@@ -59,10 +141,100 @@ void MstrieManager::save_index() {
 
 // -----------------------------------------------------------------------------------------------
 
+void MstrieManager::save_filter(const std::string &index_path, const MstrieCuckooFilter &filter, const std::string &content) {
+	// written after the index, a filter left from an older index does not match its signature
+	FileUtils::replace_file(index_path + ".filter", filter.serialize(MstrieCuckooFilter::signature(content.data(), content.size())));
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieManager::restore_filter(const char *content, size_t size) {
+	if (settings->filter_false_positive_rate <= 0 || !FileUtils::file_exists(settings->index_path + ".filter")) return;
+	mstrie->restore_filter(MstrieCuckooFilter::deserialize(FileUtils::read_from_file(settings->index_path + ".filter"),
+														  settings->alphabet,
+														  MstrieCuckooFilter::bits_for_rate(settings->filter_false_positive_rate),
+														  MstrieCuckooFilter::signature(content, size)));
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieManager::start_checkpoint() {
+	wait_checkpoint();
+	auto snapshot = mstrie->freeze();
+	unsigned long long checkpoint_lsn = 0;
+	if (wal != nullptr) {
+		// the following records go to a new segment, the checkpoint covers the rotated one
+		checkpoint_lsn = wal->last_lsn();
+		wal->rotate();
+	}
+	
+	auto progress = std::make_shared<MstrieCheckpointProgress>();
+	progress->running = true;
+	progress->multisets_total = snapshot->total_number_of_multisets;
+	progress->tp_start = std::chrono::steady_clock::now();
+	checkpoint_progress = progress;
+	
+	const MstrieStructure *structure = mstrie.get();
+	const std::string index_path = settings->index_path;
+	// the filter holds the multisets of the snapshot only now
+	auto filter = mstrie->copy_filter();
+	checkpoint_task = std::async(std::launch::async, [structure, snapshot, checkpoint_lsn, index_path, progress, filter]() mutable {
+		try {
+			std::string content = structure->retrieve_snapshot(*snapshot, checkpoint_lsn, &progress->multisets_written);
+			FileUtils::replace_file(index_path, content);
+			if (filter != nullptr) {
+				save_filter(index_path, *filter, content);
+			}
+		} catch (std::exception &e) {
+			progress->error = e.what();
+		}
+		// the nodes that are not shared anymore are freed here
+		snapshot = nullptr;
+		progress->time_taken = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - progress->tp_start).count();
+	});
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieManager::poll_checkpoint() {
+	if (checkpoint_task.valid() && checkpoint_task.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+		finish_checkpoint();
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieManager::wait_checkpoint() {
+	if (checkpoint_task.valid()) {
+		checkpoint_task.wait();
+		finish_checkpoint();
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieManager::finish_checkpoint() {
+	checkpoint_task.get();
+	checkpoint_progress->running = false;
+	mstrie->release_snapshots();
+	// the rotated records are kept until a checkpoint succeeds
+	if (wal != nullptr && checkpoint_progress->error.empty()) {
+		wal->release_rotated();
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
 void MstrieManager::flush_index(bool destroy) {
 	try {
+		if (background_checkpoint && !destroy) {
+			start_checkpoint();
+			return;
+		}
 		save_index();
 		if (destroy) {
+			wal = nullptr;
+			cache = nullptr;
 			mstrie = nullptr;
 		}
 	} catch (std::exception &e) {
@@ -72,13 +244,115 @@ void MstrieManager::flush_index(bool destroy) {
 
 // -----------------------------------------------------------------------------------------------
 
+std::string MstrieManager::print_cache_stats(){
+	if (cache == nullptr) {
+		return "Cache: disabled\n";
+	}
+	return cache->print_stats();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint MstrieManager::alphabet() const {
+	return settings->alphabet;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieManager::concurrent_queries() const {
+	return mstrie != nullptr && mstrie->concurrent_queries();
+}
+
+// -----------------------------------------------------------------------------------------------
+
 bool MstrieManager::index_exists() {
 	return mstrie != nullptr;
 }
 
 // -----------------------------------------------------------------------------------------------
 
+std::string MstrieManager::print_profile_stats(){
+	return mstrie->print_profile_stats();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+const MstrieProfile& MstrieManager::last_query_profile(){
+	return mstrie->last_query_profile();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+int MstrieManager::last_query_traversed_nodes(){
+	return mstrie->last_query_traversed_nodes();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+MstrieMemoryStats MstrieManager::memory_stats(){
+	return mstrie->memory_stats();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+int MstrieManager::number_of_nodes() {
+	return mstrie->number_of_nodes();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+int MstrieManager::number_of_multisets() {
+	return mstrie->number_of_multisets();
+}
+
+// -----------------------------------------------------------------------------------------------
+
 bool MstrieManager::search_query(const std::string &query_type, const std::string &word, int limit){
+	try {
+		if (cache == nullptr) {
+			return run_search(query_type, word, limit);
+		}
+		// the cache is keyed by the multiplicity vector
+		return search_query(query_type, mstrie->str_to_num(word), limit);
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieManager::search_query(const std::string &query_type, const std::vector<uint> &multiset, int limit){
+	try {
+		if (cache == nullptr) {
+			return run_search(query_type, multiset, limit);
+		}
+		MstrieCacheEntry::Kind kind;
+		if (query_type.compare("=") == 0)
+			kind = MstrieCacheEntry::Kind::search_exact;
+		else if (query_type.compare("<=") == 0)
+			kind = MstrieCacheEntry::Kind::search_sub;
+		else if (query_type.compare(">=") == 0)
+			kind = MstrieCacheEntry::Kind::search_sup;
+		else
+			throw MstrieStructure::MstrieException("Unknown search query");
+		uint key_limit = kind == MstrieCacheEntry::Kind::search_exact ? 0 : cache_limit(limit);
+		auto key = MstrieQueryCache::make_key(kind, multiset, key_limit);
+		bool found;
+		std::string result;
+		if (cache->lookup(key, found, result)) {
+			return found;
+		}
+		found = run_search(query_type, multiset, limit);
+		cache->store(key, kind, multiset, key_limit, found);
+		return found;
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieManager::run_search(const std::string &query_type, const std::string &word, int limit){
 	try {
 		if (query_type.compare("=") == 0) {
 			return mstrie->pub_mstrie_search(word);
@@ -99,16 +373,94 @@ bool MstrieManager::search_query(const std::string &query_type, const std::strin
 
 // -----------------------------------------------------------------------------------------------
 
+bool MstrieManager::run_search(const std::string &query_type, const std::vector<uint> &multiset, int limit){
+	try {
+		if (query_type.compare("=") == 0) {
+			return mstrie->pub_mstrie_search(multiset);
+		}
+		else if (query_type.compare("<=") == 0){
+			return mstrie->pub_mstrie_subseteq(multiset, cache_limit(limit));
+		}
+		else if (query_type.compare(">=") == 0){
+			return mstrie->pub_mstrie_superseteq(multiset, cache_limit(limit));
+		}
+		else {
+			throw MstrieStructure::MstrieException("Unknown search query");
+		}
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
 void MstrieManager::update_query(const std::string &query_type, const std::string &word){
 	try {
-		if (!query_type.compare("+")) {
-			return mstrie->pub_mstrie_insert(word);
+		poll_checkpoint();
+		if (wal == nullptr) {
+			apply_update(query_type, word);
 		}
-		else if (!query_type.compare("-")){
-			return mstrie->pub_mstrie_delete(word);
+		else {
+			// the update is checked and logged before it is applied, so the index holds no
+			// change that is missing in the log and the replay cannot fail on a record
+			bool insert;
+			std::vector<uint> multiset = check_update(query_type, word, {}, insert);
+			wal->append(query_type, word);
+			apply_update(multiset, insert);
+			if (wal->checkpoint_due() && !checkpoint_progress->running) {
+				if (background_checkpoint)
+					start_checkpoint();
+				else
+					save_index();
+			}
+		}
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieManager::update_batch(const std::vector<std::pair<std::string, std::string>> &updates, std::vector<std::string> &errors){
+	try {
+		poll_checkpoint();
+		errors.assign(updates.size(), "");
+		if (wal == nullptr) {
+			for (size_t i = 0; i < updates.size(); i++) {
+				try {
+					apply_update(updates[i].first, updates[i].second);
+				} catch (std::exception &e) {
+					errors[i] = e.what();
+				}
+			}
 		}
 		else {
-			throw MstrieStructure::MstrieException("Unknown update query");
+			// the updates that pass the check are logged with one commit before any is applied,
+			// each is checked against the index as the preceding updates of the batch leave it
+			std::map<std::vector<uint>, bool> stored;
+			std::vector<std::pair<std::string, std::string>> logged;
+			std::vector<std::pair<std::vector<uint>, bool>> checked;
+			for (size_t i = 0; i < updates.size(); i++) {
+				try {
+					bool insert;
+					std::vector<uint> multiset = check_update(updates[i].first, updates[i].second, stored, insert);
+					stored[multiset] = insert;
+					logged.push_back(updates[i]);
+					checked.emplace_back(std::move(multiset), insert);
+				} catch (std::exception &e) {
+					errors[i] = e.what();
+				}
+			}
+			wal->append_group(logged);
+			for (auto &update : checked) {
+				apply_update(update.first, update.second);
+			}
+			if (wal->checkpoint_due() && !checkpoint_progress->running) {
+				if (background_checkpoint)
+					start_checkpoint();
+				else
+					save_index();
+			}
 		}
 	} catch (std::exception &e) {
 		throw;
@@ -117,7 +469,158 @@ void MstrieManager::update_query(const std::string &query_type, const std::strin
 
 // -----------------------------------------------------------------------------------------------
 
+bool MstrieManager::update_kind(const std::string &query_type){
+	if (!query_type.compare("+")) {
+		return true;
+	}
+	else if (!query_type.compare("-")){
+		return false;
+	}
+	throw MstrieStructure::MstrieException("Unknown update query");
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::vector<uint> MstrieManager::check_update(const std::string &query_type, const std::string &word, const std::map<std::vector<uint>, bool> &stored, bool &insert){
+	insert = update_kind(query_type);
+	std::vector<uint> multiset = mstrie->str_to_num(word);
+	auto previous = stored.find(multiset);
+	bool present = previous != stored.end() ? previous->second : mstrie->contains(multiset);
+	/* An insertion of a valid vector cannot fail, a deletion fails for a missing multiset */
+	if (!insert && !present) {
+		throw MstrieStructure::MstrieException("Deletion failed: nothing to delete.");
+	}
+	return multiset;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieManager::apply_update(const std::string &query_type, const std::string &word){
+	bool insert = update_kind(query_type);
+	/* The word is parsed once, for the update and for the invalidation of the cache */
+	apply_update(mstrie->str_to_num(word), insert);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieManager::apply_update(const std::vector<uint> &multiset, bool insert){
+	if (insert)
+		mstrie->pub_mstrie_insert(multiset);
+	else
+		mstrie->pub_mstrie_delete(multiset);
+	if (cache != nullptr) {
+		cache->invalidate(multiset, insert);
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint MstrieManager::cache_limit(int limit) const {
+	// the structure takes the highest multiplicity for a greater limit
+	if (limit < 0 || static_cast<uint>(limit) > settings->max_multiplicity)
+		return settings->max_multiplicity;
+	return static_cast<uint>(limit);
+}
+
+// -----------------------------------------------------------------------------------------------
+
 std::string MstrieManager::retrieve_query(const std::string &query_type, const std::string &word, int limit){
+	try {
+		if (cache == nullptr) {
+			return run_retrieve(query_type, word, limit);
+		}
+		// an exact retrieval is the search of its word
+		if (query_type.compare("=") == 0) {
+			return search_query(query_type, word, limit) ? word : "";
+		}
+		MstrieCacheEntry::Kind kind;
+		if (query_type.compare("<=") == 0)
+			kind = MstrieCacheEntry::Kind::retrieve_sub;
+		else if (query_type.compare(">=") == 0)
+			kind = MstrieCacheEntry::Kind::retrieve_sup;
+		else
+			throw MstrieStructure::MstrieException("Unknown retrieve query");
+		auto multiset = mstrie->str_to_num(word);
+		uint key_limit = cache_limit(limit);
+		auto key = MstrieQueryCache::make_key(kind, multiset, key_limit);
+		bool found;
+		std::string result;
+		if (cache->lookup(key, found, result)) {
+			return result;
+		}
+		result = run_retrieve(query_type, word, limit);
+		cache->store(key, kind, multiset, key_limit, !result.empty(), result);
+		return result;
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieManager::retrieve_query(const std::string &query_type, const std::string &word, int limit, uint min_cardinality, int max_cardinality){
+	try {
+		if (min_cardinality == 0 && max_cardinality < 0) {
+			return retrieve_query(query_type, word, limit);
+		}
+		uint max_bound = max_cardinality < 0 ? static_cast<uint>(-1) : static_cast<uint>(max_cardinality);
+		if (query_type.compare("=") == 0) {
+			auto multiset = mstrie->str_to_num(word);
+			uint cardinality = 0;
+			for (auto multiplicity : multiset) cardinality += multiplicity;
+			if (cardinality < min_cardinality || cardinality > max_bound)
+				return "";
+			return mstrie->pub_mstrie_search(word) ? word : "";
+		}
+		else if (query_type.compare("<=") == 0) {
+			return mstrie->pub_mstrie_get_subseteq(word, limit, min_cardinality, max_bound);
+		}
+		else if (query_type.compare(">=") == 0) {
+			return mstrie->pub_mstrie_get_superseteq(word, limit, min_cardinality, max_bound);
+		}
+		else {
+			throw MstrieStructure::MstrieException("Unknown retrieve query");
+		}
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieManager::retrieve_query(const std::string &query_type, const std::vector<uint> &multiset, int limit, uint min_cardinality, int max_cardinality, MstrieVisitor &visitor){
+	try {
+		bool bounded = min_cardinality > 0 || max_cardinality >= 0;
+		uint max_bound = max_cardinality < 0 ? static_cast<uint>(-1) : static_cast<uint>(max_cardinality);
+		if (query_type.compare("=") == 0) {
+			uint cardinality = 0;
+			for (auto multiplicity : multiset) cardinality += multiplicity;
+			if (cardinality >= min_cardinality && cardinality <= max_bound && search_query(query_type, multiset, limit))
+				visitor.visit(multiset.data());
+		}
+		else if (query_type.compare("<=") == 0) {
+			if (bounded)
+				mstrie->pub_mstrie_get_subseteq(multiset, cache_limit(limit), min_cardinality, max_bound, visitor);
+			else
+				mstrie->pub_mstrie_get_subseteq(multiset, cache_limit(limit), visitor);
+		}
+		else if (query_type.compare(">=") == 0) {
+			if (bounded)
+				mstrie->pub_mstrie_get_superseteq(multiset, cache_limit(limit), min_cardinality, max_bound, visitor);
+			else
+				mstrie->pub_mstrie_get_superseteq(multiset, cache_limit(limit), visitor);
+		}
+		else {
+			throw MstrieStructure::MstrieException("Unknown retrieve query");
+		}
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieManager::run_retrieve(const std::string &query_type, const std::string &word, int limit){
 	try {
 		std::vector<std::string> results = std::vector<std::string>();
 		if (query_type.compare("=") == 0){
@@ -142,6 +645,55 @@ std::string MstrieManager::retrieve_query(const std::string &query_type, const s
 
 // -----------------------------------------------------------------------------------------------
 
+std::string MstrieManager::retrieve_extremal_query(const std::string &query_type, const std::string &word, int limit){
+	try {
+		if (query_type.compare("<=") == 0) {
+			return mstrie->pub_mstrie_get_maximal_subseteq(word, limit);
+		}
+		else if (query_type.compare(">=") == 0) {
+			return mstrie->pub_mstrie_get_minimal_superseteq(word, limit);
+		}
+		else {
+			throw MstrieStructure::MstrieException("Unknown extremal retrieve query");
+		}
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieManager::within_query(const std::string &query_type, const std::string &word, uint distance){
+	try {
+		if (query_type.compare("~") == 0) {
+			return mstrie->pub_mstrie_get_within(word, distance);
+		}
+		else if (query_type.compare("<=") == 0) {
+			return mstrie->pub_mstrie_get_subseteq_within(word, distance);
+		}
+		else if (query_type.compare(">=") == 0) {
+			return mstrie->pub_mstrie_get_superseteq_within(word, distance);
+		}
+		else {
+			throw MstrieStructure::MstrieException("Unknown within query");
+		}
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieManager::nearest_query(const std::string &word, uint k, const std::string &weights){
+	try {
+		return mstrie->pub_mstrie_get_nearest(word, k, weights);
+	} catch (std::exception &e) {
+		throw;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
 std::string MstrieManager::print_full_stats(){
 	return mstrie->print_full_stats();
 }
@@ -163,3 +715,31 @@ std::string MstrieManager::print_last_query_stats(){
 std::string MstrieManager::print_benchmark_stats(){
 	return mstrie->print_benchmark_stats();
 }
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieManager::print_checkpoint_stats(){
+	poll_checkpoint();
+	auto progress = checkpoint_progress;
+	std::string stats = "Checkpoint: ";
+	if (progress->running) {
+		unsigned long written = progress->multisets_written;
+		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - progress->tp_start).count();
+		stats += "running";
+		stats += "; multisets: " + std::to_string(written) + "/" + std::to_string(progress->multisets_total);
+		if (progress->multisets_total > 0) {
+			stats += " (" + std::to_string(written * 100 / progress->multisets_total) + "%)";
+		}
+		stats += "; time: " + std::to_string(elapsed) + " ms";
+	}
+	else if (progress->time_taken < 0) {
+		stats += "none";
+	}
+	else {
+		stats += progress->error.empty() ? "done" : "failed: " + progress->error;
+		stats += "; multisets: " + std::to_string(progress->multisets_written) + "/" + std::to_string(progress->multisets_total);
+		stats += "; time: " + std::to_string(progress->time_taken) + " ms";
+	}
+	stats += "\n";
+	return stats;
+}
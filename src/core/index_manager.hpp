@@ -9,31 +9,123 @@
 #ifndef INDEX_MANAGER_HPP
 #define INDEX_MANAGER_HPP
 
+#include <future>
+#include <map>
 #include "mstrie.hpp"
+#include "query_cache.hpp"
+#include "write_ahead_log.hpp"
+#include "../lib/configurator.hpp"
 
 
+/* Progress of the last checkpoint */
+class MstrieCheckpointProgress {
+public:
+	bool running;
+	// written by the checkpoint thread
+	std::atomic<unsigned long> multisets_written;
+	unsigned long multisets_total;
+	std::chrono::steady_clock::time_point tp_start;
+	long time_taken;
+	std::string error;
+	
+	MstrieCheckpointProgress();
+};
+
 /* Manager for MstrieStructure instance */
 class MstrieManager {
 private:
 	std::unique_ptr<MstrieSettings> settings;
 	std::unique_ptr<MstrieStructure> mstrie;
 	
+	std::unique_ptr<MstrieWalSettings> wal_settings;
+	std::unique_ptr<MstrieWal> wal;
+	
+	// checkpoints are taken from a snapshot in another thread
+	const bool background_checkpoint;
+	std::shared_ptr<MstrieCheckpointProgress> checkpoint_progress;
+	std::future<void> checkpoint_task;
+	
+	// number of threads that parse the index file, 0 - one per hardware thread
+	uint load_threads;
+	
+	// results of repeated queries, none if the budget is 0
+	size_t cache_bytes;
+	std::unique_ptr<MstrieQueryCache> cache;
+	
 	void create_index();
 	void save_index();
+	// the membership filter is saved next to the index file, with the signature of its content
+	static void save_filter(const std::string &index_path, const MstrieCuckooFilter &filter, const std::string &content);
+	// hands a saved filter that matches the content of the index file to the structure
+	void restore_filter(const char *content, size_t size);
+	// true for an insertion, false for a deletion
+	static bool update_kind(const std::string &query_type);
+	// parses an update and throws if applying it would fail, so it can be logged before it is
+	// applied; stored overrides the index for the multisets of the preceding updates of a batch
+	std::vector<uint> check_update(const std::string &query_type, const std::string &word, const std::map<std::vector<uint>, bool> &stored, bool &insert);
+	void apply_update(const std::string &query_type, const std::string &word);
+	void apply_update(const std::vector<uint> &multiset, bool insert);
+	bool run_search(const std::string &query_type, const std::string &word, int limit);
+	bool run_search(const std::string &query_type, const std::vector<uint> &multiset, int limit);
+	std::string run_retrieve(const std::string &query_type, const std::string &word, int limit);
+	// limit of the structure for the limit of a query, -1 - none
+	uint cache_limit(int limit) const;
+	
+	void start_checkpoint();
+	// finishes the checkpoint if its thread is done
+	void poll_checkpoint();
+	void wait_checkpoint();
+	void finish_checkpoint();
 public:
-	MstrieManager(const MstrieSettings &settings);
+	MstrieManager(const MstrieSettings &settings, const MstrieWalSettings &wal_settings = MstrieWalSettings(), bool background_checkpoint = false);
+	~MstrieManager();
+	
+	// creates manager for the mstrie configured in group mstrie_name,
+	// with the statistics level default_statistics unless one is configured
+	static std::unique_ptr<MstrieManager> from_config(Configurator &config, const std::string &mstrie_name, const std::string &default_statistics = "full");
 	
 	void init_index();
+	// saves the index, in background if configured, unless it is destroyed
 	void flush_index(bool destroy);
 	
 	/* queries */
 	bool search_query(const std::string &query_type, const std::string &word, int limit = -1);
 	void update_query(const std::string &query_type, const std::string &word);
+	// applies the updates in order and commits them to the log together,
+	// errors gets the message of every update that failed, empty if it succeeded
+	void update_batch(const std::vector<std::pair<std::string, std::string>> &updates, std::vector<std::string> &errors);
 	std::string retrieve_query(const std::string &query_type, const std::string &word, int limit = -1);
+	// retrieval of the multisets with a cardinality in [min_cardinality, max_cardinality],
+	// max_cardinality -1 - none, the bounded results are not cached
+	std::string retrieve_query(const std::string &query_type, const std::string &word, int limit, uint min_cardinality, int max_cardinality);
+	// '<=' - the maximal closest sub, '>=' - the minimal closest super, not cached
+	std::string retrieve_extremal_query(const std::string &query_type, const std::string &word, int limit = -1);
+	// the multisets within a total distance of word: '~' - L1 distance, '<=' - submultisets,
+	// '>=' - supermultisets, not cached
+	std::string within_query(const std::string &query_type, const std::string &word, uint distance);
+	// the k nearest multisets by L1 distance, weighted if weights are given, not cached
+	std::string nearest_query(const std::string &word, uint k, const std::string &weights = "");
+	
+	/* queries on multiplicity vectors of alphabet multiplicities */
+	bool search_query(const std::string &query_type, const std::vector<uint> &multiset, int limit = -1);
+	// hands the multisets with a cardinality in [min_cardinality, max_cardinality] to visitor
+	// during the traversal until it stops them, max_cardinality -1 - none; not cached
+	void retrieve_query(const std::string &query_type, const std::vector<uint> &multiset, int limit, uint min_cardinality, int max_cardinality, MstrieVisitor &visitor);
 	std::string print_full_stats();
 	std::string print_total_stats();
 	std::string print_last_query_stats();
 	std::string print_benchmark_stats();
+	std::string print_checkpoint_stats();
+	std::string print_cache_stats();
+	std::string print_profile_stats();
+	const MstrieProfile& last_query_profile();
+	int last_query_traversed_nodes();
+	MstrieMemoryStats memory_stats();
+	int number_of_nodes();
+	int number_of_multisets();
+	uint alphabet() const;
+	// searches and retrievals may run on several threads at once, with no update among them
+	bool concurrent_queries() const;
 	
 	bool index_exists();
 };
@@ -0,0 +1,223 @@
+//
+//  membership_filter.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "membership_filter.hpp"
+#include "hash_index.hpp"
+
+namespace {
+	const char filter_magic[] = "MSTRIECF";
+	// magic and the fields signature, alphabet, bits, buckets and items
+	const size_t filter_header = 8 + 5 * sizeof(uint64_t);
+}
+
+
+MstrieCuckooFilter::MstrieCuckooFilter(uint alphabet, uint bits, size_t buckets)
+: alphabet(alphabet),
+bits(bits),
+buckets(buckets),
+width(bits / 8),
+table(buckets * bucket_slots * (bits / 8), 0),
+items(0) {
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint MstrieCuckooFilter::bits_for_rate(double rate) {
+	// a lookup compares 2 * bucket_slots fingerprints
+	double needed = std::log2(2.0 * bucket_slots / std::max(rate, 1e-9));
+	if (needed <= 8) return 8;
+	if (needed <= 16) return 16;
+	return 32;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+size_t MstrieCuckooFilter::buckets_for(size_t multisets) {
+	// the insertions start failing at about 95% of the slots
+	size_t needed = static_cast<size_t>(multisets / (bucket_slots * 0.85)) + 1;
+	size_t buckets = 256;
+	while (buckets < needed) buckets <<= 1;
+	return buckets;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint32_t MstrieCuckooFilter::slot(size_t bucket, uint i) const {
+	const uint8_t *data = table.data() + (bucket * bucket_slots + i) * width;
+	if (width == 1) return *data;
+	uint32_t fingerprint = 0;
+	memcpy(&fingerprint, data, width);
+	return fingerprint;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieCuckooFilter::set_slot(size_t bucket, uint i, uint32_t fingerprint) {
+	uint8_t *data = table.data() + (bucket * bucket_slots + i) * width;
+	if (width == 1) *data = static_cast<uint8_t>(fingerprint);
+	else memcpy(data, &fingerprint, width);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+size_t MstrieCuckooFilter::alternate(size_t bucket, uint32_t fingerprint) const {
+	return (bucket ^ (fingerprint * 0x5BD1E995ull)) & (buckets - 1);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieCuckooFilter::locate(const uint *v, size_t &bucket, uint32_t &fingerprint) const {
+	uint64_t h = MstrieHashIndex::hash(v, alphabet);
+	bucket = h & (buckets - 1);
+	fingerprint = static_cast<uint32_t>(h >> 32);
+	if (bits < 32) fingerprint &= (1u << bits) - 1;
+	// 0 marks an empty slot
+	if (fingerprint == 0) fingerprint = 1;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieCuckooFilter::bucket_contains(size_t bucket, uint32_t fingerprint) const {
+	for (uint i = 0; i < bucket_slots; i++) {
+		if (slot(bucket, i) == fingerprint) return true;
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieCuckooFilter::bucket_add(size_t bucket, uint32_t fingerprint) {
+	for (uint i = 0; i < bucket_slots; i++) {
+		if (slot(bucket, i) == 0) {
+			set_slot(bucket, i, fingerprint);
+			return true;
+		}
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieCuckooFilter::contains(const uint *v) const {
+	size_t bucket;
+	uint32_t fingerprint;
+	locate(v, bucket, fingerprint);
+	return bucket_contains(bucket, fingerprint) || bucket_contains(alternate(bucket, fingerprint), fingerprint);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieCuckooFilter::insert(const uint *v) {
+	size_t bucket;
+	uint32_t fingerprint;
+	locate(v, bucket, fingerprint);
+	items++;
+	if (bucket_add(bucket, fingerprint)) return true;
+	bucket = alternate(bucket, fingerprint);
+	if (bucket_add(bucket, fingerprint)) return true;
+	// move a fingerprint of a full bucket to its other bucket, the slot is chosen by the kick number
+	for (uint kick = 0; kick < max_kicks; kick++) {
+		uint i = (kick * 7 + static_cast<uint>(fingerprint)) % bucket_slots;
+		uint32_t evicted = slot(bucket, i);
+		set_slot(bucket, i, fingerprint);
+		fingerprint = evicted;
+		bucket = alternate(bucket, fingerprint);
+		if (bucket_add(bucket, fingerprint)) return true;
+	}
+	return false;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieCuckooFilter::erase(const uint *v) {
+	size_t bucket;
+	uint32_t fingerprint;
+	locate(v, bucket, fingerprint);
+	for (size_t b : { bucket, alternate(bucket, fingerprint) }) {
+		for (uint i = 0; i < bucket_slots; i++) {
+			if (slot(b, i) == fingerprint) {
+				set_slot(b, i, 0);
+				items--;
+				return;
+			}
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+size_t MstrieCuckooFilter::size() const {
+	return items;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+size_t MstrieCuckooFilter::bucket_count() const {
+	return buckets;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint MstrieCuckooFilter::fingerprint_bits() const {
+	return bits;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+double MstrieCuckooFilter::false_positive_rate() const {
+	return std::min(1.0, 2.0 * bucket_slots / std::pow(2.0, bits));
+}
+
+// -----------------------------------------------------------------------------------------------
+
+unsigned long MstrieCuckooFilter::memory_bytes() const {
+	return table.capacity();
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+uint64_t MstrieCuckooFilter::signature(const char *index, size_t size) {
+	// FNV-1a of the first bytes, seeded by the size
+	uint64_t h = 0xCBF29CE484222325ull ^ size;
+	for (size_t i = 0; i < std::min<size_t>(size, 64); i++) {
+		h = (h ^ static_cast<uint8_t>(index[i])) * 0x100000001B3ull;
+	}
+	return h;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieCuckooFilter::serialize(uint64_t signature) const {
+	std::string data(filter_magic, 8);
+	for (uint64_t field : { signature, static_cast<uint64_t>(alphabet), static_cast<uint64_t>(bits), static_cast<uint64_t>(buckets), static_cast<uint64_t>(items) }) {
+		data.append(reinterpret_cast<const char*>(&field), sizeof(field));
+	}
+	data.append(reinterpret_cast<const char*>(table.data()), table.size());
+	return data;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::unique_ptr<MstrieCuckooFilter> MstrieCuckooFilter::deserialize(const std::string &data, uint alphabet, uint bits, uint64_t signature) {
+	if (data.size() < filter_header || data.compare(0, 8, filter_magic, 8) != 0) return nullptr;
+	uint64_t fields[5];
+	memcpy(fields, data.data() + 8, sizeof(fields));
+	size_t buckets = fields[3];
+	if (fields[0] != signature || fields[1] != alphabet || fields[2] != bits
+		|| buckets == 0 || (buckets & (buckets - 1)) != 0
+		|| data.size() != filter_header + buckets * bucket_slots * (bits / 8)) {
+		return nullptr;
+	}
+	auto filter = std::make_unique<MstrieCuckooFilter>(alphabet, bits, buckets);
+	memcpy(filter->table.data(), data.data() + filter_header, filter->table.size());
+	filter->items = fields[4];
+	return filter;
+}
@@ -0,0 +1,78 @@
+//
+//  membership_filter.hpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#ifndef MEMBERSHIP_FILTER_HPP
+#define MEMBERSHIP_FILTER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/* Cuckoo filter of the stored multisets
+ *
+ * Answers whether a multiset may be stored: a negative answer is exact,
+ * a positive one is wrong at the false-positive rate of the fingerprint
+ * size. Every multiset has a fingerprint in one of its two buckets of
+ * four slots, so a lookup reads two buckets and a deletion removes the
+ * fingerprint without affecting other multisets. The filter cannot grow,
+ * its owner rebuilds it larger from the multisets when it is full.
+ */
+class MstrieCuckooFilter {
+private:
+	static const uint bucket_slots = 4;
+	// relocations tried by an insertion before the filter is full
+	static const uint max_kicks = 500;
+	
+	const uint alphabet;
+	// bits of a fingerprint, 8, 16 or 32
+	const uint bits;
+	// power of two
+	const size_t buckets;
+	// bytes per slot, 0 in a slot is empty
+	const uint width;
+	std::vector<uint8_t> table;
+	size_t items;
+	
+	uint32_t slot(size_t bucket, uint i) const;
+	void set_slot(size_t bucket, uint i, uint32_t fingerprint);
+	// the other bucket of a fingerprint
+	size_t alternate(size_t bucket, uint32_t fingerprint) const;
+	void locate(const uint *v, size_t &bucket, uint32_t &fingerprint) const;
+	bool bucket_contains(size_t bucket, uint32_t fingerprint) const;
+	bool bucket_add(size_t bucket, uint32_t fingerprint);
+public:
+	MstrieCuckooFilter(uint alphabet, uint bits, size_t buckets);
+	
+	// smallest fingerprint size with at most the false-positive rate
+	static uint bits_for_rate(double rate);
+	// buckets to hold the number of multisets with some room
+	static size_t buckets_for(size_t multisets);
+	
+	bool contains(const uint *v) const;
+	// false if the filter is full, a fingerprint is lost then and the filter must be rebuilt
+	bool insert(const uint *v);
+	// the multiset must have been inserted
+	void erase(const uint *v);
+	
+	size_t size() const;
+	size_t bucket_count() const;
+	uint fingerprint_bits() const;
+	// upper bound of the false-positive rate
+	double false_positive_rate() const;
+	unsigned long memory_bytes() const;
+	
+	/* persistence next to the index file */
+	// hash of the size and the head of an index file, which holds its timestamp and checkpoint lsn
+	static uint64_t signature(const char *index, size_t size);
+	std::string serialize(uint64_t signature) const;
+	// nullptr if data is not a filter of the parameters saved with the index of the signature
+	static std::unique_ptr<MstrieCuckooFilter> deserialize(const std::string &data, uint alphabet, uint bits, uint64_t signature);
+};
+
+#endif /* MEMBERSHIP_FILTER_HPP */
@@ -6,14 +6,46 @@
 //  Copyright © 2018 Mikita Akulich. All rights reserved.
 //
 
+#include <algorithm>
 #include <iostream>
 #include <stdexcept>
 #include <string>
 #include <sstream>
 #include <vector>
 #include <ctime>
+#include <cstdlib>
+#include <cstring>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include "mstrie.hpp"
+#include "mstrie_loader.hpp"
+#include "query_trace.hpp"
+
+// the statements that record query profiles are compiled only with MSTRIE_PROFILE
+#ifdef MSTRIE_PROFILE
+#define MSTRIE_PROFILE_RECORD(...) __VA_ARGS__
+#else
+#define MSTRIE_PROFILE_RECORD(...)
+#endif
+
+// the highest statistics level, the checks above it are removed by the compiler
+#ifndef MSTRIE_STATISTICS
+#define MSTRIE_STATISTICS 2
+#endif
+#define MSTRIE_STATS_ENABLED(level) (MSTRIE_STATISTICS >= static_cast<int>(level) && _settings->statistics >= (level))
+
+// the sinks of the retrieval traversals: found collects the vectors and never stops the
+// traversal, a visitor gets each vector and stops the traversal by returning false
+static inline bool add_found(std::vector<uint> &found, const std::vector<uint> &sv_output){
+	found.insert(found.end(), sv_output.begin(), sv_output.end());
+	return true;
+}
+
+static inline bool add_found(MstrieVisitor &visitor, const std::vector<uint> &sv_output){
+	return visitor.visit(sv_output.data());
+}
 
 /* ------------------------------------------------------------------
  * Converter
@@ -21,35 +53,61 @@
  */
 std::vector<uint> MstrieStructure::str_to_num(const std::string &token){
 	std::vector<uint> v (_settings->alphabet, 0);
-	if (!token.compare("*")) {
-		return v;
-	}
-	std::string el;
-	char delimiter = ',';
-	std::istringstream tokenStream(token);
-	while (std::getline(tokenStream, el, delimiter)) {
-		auto el_int = std::stoi(el);
-		if (el_int < 0) {
-			throw MstrieException("Token cannot have negative values.");
-		}
-		if (el_int > _settings->alphabet - 1) {
-			throw MstrieException("Token cannot have values greater than alphabet size.");
-		}
-		v[el_int]++;
-	}
+	MstrieLoader::parse_multiset(token.data(), token.data() + token.size(), _settings->alphabet, _settings->max_multiplicity, v.data());
 	return v;
 }
 
 // -----------------------------------------------------------------------------------------------
 
-std::string MstrieStructure::num_to_str(const std::vector<uint> &v) {
+std::string MstrieStructure::num_to_str(const std::vector<uint> &v) const {
 	std::string s;
-	for (size_t ch = 0; ch < v.size(); ch++) {
-		for (int i = 0; i<v[ch]; i++) {
-			s += std::to_string(ch) + ",";
+	append_num_str(v.data(), v.size(), s);
+	return s;
+}
+
+void MstrieStructure::append_num_str(const uint *v, size_t size, std::string &s) const {
+	// appends the decimal digits of number
+	auto append_uint = [&s](uint number) {
+		char digits[10];
+		int n = 0;
+		do {
+			digits[n++] = '0' + number % 10;
+			number /= 10;
+		} while (number > 0);
+		while (n > 0) s += digits[--n];
+	};
+	bool first = true;
+	for (uint ch = 0; ch < size; ch++) {
+		if (v[ch] == 0) continue;
+		if (_settings->run_length_notation) {
+			// element:multiplicity, the multiplicity 1 is omitted
+			if (!first) s += ',';
+			append_uint(ch);
+			if (v[ch] > 1) {
+				s += ':';
+				append_uint(v[ch]);
+			}
+			first = false;
+		}
+		else {
+			for (uint i = 0; i < v[ch]; i++) {
+				if (!first) s += ',';
+				append_uint(ch);
+				first = false;
+			}
 		}
 	}
-	return s.substr(0, s.size() -1);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::join_found(const std::vector<uint> &found) const {
+	std::string output;
+	for (size_t i = 0; i < found.size(); i += _settings->alphabet) {
+		if (i > 0) output += '|';
+		append_num_str(found.data() + i, _settings->alphabet, output);
+	}
+	return output;
 }
 
 // ===============================================================================================
@@ -59,10 +117,28 @@ std::string MstrieStructure::num_to_str(const std::vector<uint> &v) {
  * Constructors/Destructors
  * ------------------------------------------------------------------
  */
-MstrieSettings::MstrieSettings(uint alphabet, uint max_multiplicity, const std::string &index_path)
+MstrieSettings::MstrieSettings(uint alphabet, uint max_multiplicity, const std::string &index_path, bool run_length_notation, bool compressed_format, MstrieStatsLevel statistics, bool hash_index, double filter_false_positive_rate)
 : alphabet(alphabet),
 max_multiplicity(max_multiplicity),
-index_path(index_path) {};
+index_path(index_path),
+run_length_notation(run_length_notation),
+compressed_format(compressed_format),
+statistics(std::min(statistics, static_cast<MstrieStatsLevel>(MSTRIE_STATISTICS))),
+hash_index(hash_index),
+filter_false_positive_rate(filter_false_positive_rate) {};
+
+MstrieStatsLevel MstrieSettings::parse_statistics_level(const std::string &level) {
+	if (level.compare("none") == 0) {
+		return MstrieStatsLevel::none;
+	}
+	else if (level.compare("counters") == 0) {
+		return MstrieStatsLevel::counters;
+	}
+	else if (level.compare("full") == 0) {
+		return MstrieStatsLevel::full;
+	}
+	throw std::runtime_error("Unknown statistics level: " + level);
+}
 
 // -----------------------------------------------------------------------------------------------
 
@@ -70,53 +146,121 @@ MstrieStructure::MstrieStructure(const MstrieSettings &settings)
 : _root(std::make_shared<MstrieNode>(settings.max_multiplicity)),
 _dummy(std::make_shared<MstrieNode>(0)),
 _settings(std::make_unique<MstrieSettings>(settings)){
-	statistics = std::make_unique<MstrieStats>();
+	statistics.last_query_profile = MstrieProfile(settings.alphabet + 1);
+	// the acceptor ends every multiset
+	_dummy->min_cardinality = 0;
+	if (settings.hash_index) {
+		hash_index = std::make_unique<MstrieHashIndex>(settings.alphabet, settings.max_multiplicity);
+	}
+	if (settings.filter_false_positive_rate > 0) {
+		filter = std::make_unique<MstrieCuckooFilter>(settings.alphabet, MstrieCuckooFilter::bits_for_rate(settings.filter_false_positive_rate), MstrieCuckooFilter::buckets_for(0));
+	}
+	filter_restored = false;
+	epoch = 0;
+	frozen = false;
 }
 
 // -----------------------------------------------------------------------------------------------
 
-MstrieNode::MstrieNode(const uint max_multiplicity) {
+MstrieNode::MstrieNode(const uint max_multiplicity, const uint epoch) {
 	this->mult_switch = std::make_shared<std::vector<std::shared_ptr<MstrieNode>>>(max_multiplicity+1, nullptr);
+	this->epoch = epoch;
+	// no multiset below yet
+	this->min_cardinality = cardinality_unbounded;
+	this->max_cardinality = 0;
+}
+
+MstrieNode::MstrieNode(const MstrieNode &node, const uint epoch) {
+	this->mult_switch = std::make_shared<std::vector<std::shared_ptr<MstrieNode>>>(*node.mult_switch);
+	this->epoch = epoch;
+	this->min_cardinality = node.min_cardinality;
+	this->max_cardinality = node.max_cardinality;
+}
+
+void MstrieNode::include_cardinality(uint cardinality) {
+	// a too large minimum is still a lower bound, a too large maximum is not known
+	uint16_t bounded = static_cast<uint16_t>(std::min<uint>(cardinality, cardinality_unbounded));
+	if (bounded < min_cardinality) min_cardinality = bounded;
+	if (bounded > max_cardinality) max_cardinality = bounded;
 }
 
 // -----------------------------------------------------------------------------------------------
 
-MstrieStats::MstrieStats(const std::string &units){
+MstrieSnapshot::MstrieSnapshot(const std::shared_ptr<MstrieNode> &root, int total_number_of_multisets)
+: root(root),
+total_number_of_multisets(total_number_of_multisets) {};
+
+// -----------------------------------------------------------------------------------------------
+
+MstrieStats::MstrieStats(const std::string &units)
+: time_units(units) {
 	// the root node and dummy are always present when mstrie structure is present
 	total_number_of_nodes = 2;
 	total_number_of_multisets = 0;
 	last_query_traversed_nodes = 0;
 	last_query_time_taken = 0;
 	last_query_name = "";
-	time_units = units;
+	// the units are resolved once, not on every query
+	if (time_units.compare("s") == 0) {
+		time_unit_ns = 1000000000;
+	}
+	else if (time_units.compare("ms") == 0) {
+		time_unit_ns = 1000000;
+	}
+	else if (time_units.compare("µs") == 0) {
+		time_unit_ns = 1000;
+	}
+	else if (time_units.compare("ns") == 0) {
+		time_unit_ns = 1;
+	}
+	else {
+		throw std::runtime_error("Unknown time units.");
+	}
 }
 
 // ===============================================================================================
 // ===============================================================================================
 
-void MstrieStructure::mstrie_insert(const std::vector<uint> &sv_input)
+const std::shared_ptr<MstrieNode>& MstrieStructure::writable(std::shared_ptr<MstrieNode> &slot) {
+	if (frozen && slot->epoch != epoch) {
+		slot = std::make_shared<MstrieNode>(*slot, epoch);
+	}
+	return slot;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::mstrie_insert(const uint *sv_input)
 {
-	std::shared_ptr<MstrieNode> root_p = std::move(_root);
+	std::shared_ptr<MstrieNode> root_p = writable(_root);
 	int i = 0;
+	// cardinality of the multiset from the current level on
+	uint rest = 0;
+	for (uint j = 0; j < _settings->alphabet; j++) rest += sv_input[j];
 	try {
 		/* Go down to leaf level */
 		while (i<_settings->alphabet-1) {
+			root_p->include_cardinality(rest);
+			rest -= sv_input[i];
 			/* Node already exists */
 			if (root_p->mult_switch->at(sv_input[i]) != nullptr) {
-				root_p = root_p->mult_switch->at(sv_input[i]);
+				root_p = writable(root_p->mult_switch->at(sv_input[i]));
 			}
 			/* Insert a new node */
 			else {
-				root_p->mult_switch->at(sv_input[i]) = std::make_shared<MstrieNode>(_settings->max_multiplicity);
+				root_p->mult_switch->at(sv_input[i]) = std::make_shared<MstrieNode>(_settings->max_multiplicity, epoch);
 				root_p = root_p->mult_switch->at(sv_input[i]);
-				statistics->total_number_of_nodes++;
+				statistics.total_number_of_nodes++;
 			}
 			++i;
 		}
 		/* Set pointer in leaf node to acceptor */
 		if (root_p->mult_switch->at(sv_input[i]) != _dummy) {
-			statistics->total_number_of_multisets++;
+			root_p->include_cardinality(rest);
+			statistics.total_number_of_multisets++;
 			root_p->mult_switch->at(sv_input[i]) = _dummy;
+			if (hash_index != nullptr) hash_index->insert(sv_input);
+			if (filter != nullptr) filter_insert(sv_input);
 		}
 	} catch (std::exception &e) {
 		throw std::runtime_error("Insertion failed: " + std::string(e.what()));
@@ -126,9 +270,41 @@ void MstrieStructure::mstrie_insert(const std::vector<uint> &sv_input)
 
 // -----------------------------------------------------------------------------------------------
 
+void MstrieStructure::mstrie_insert_from(const uint *sv_input, uint level, std::vector<MstrieNode*> &path)
+{
+	try {
+		/* Go down to leaf level, the nodes above level are shared with the previous multiset */
+		for (uint i = level; i < _settings->alphabet - 1; i++) {
+			std::shared_ptr<MstrieNode> &child = path[i]->mult_switch->at(sv_input[i]);
+			if (child == nullptr) {
+				child = std::make_shared<MstrieNode>(_settings->max_multiplicity, epoch);
+				statistics.total_number_of_nodes++;
+			}
+			path[i+1] = child.get();
+		}
+		/* Set pointer in leaf node to acceptor */
+		uint leaf = _settings->alphabet - 1;
+		if (path[leaf]->mult_switch->at(sv_input[leaf]) != _dummy) {
+			uint rest = 0;
+			for (uint i = leaf + 1; i-- > 0; ) {
+				rest += sv_input[i];
+				path[i]->include_cardinality(rest);
+			}
+			statistics.total_number_of_multisets++;
+			path[leaf]->mult_switch->at(sv_input[leaf]) = _dummy;
+			if (hash_index != nullptr) hash_index->insert(sv_input);
+			if (filter != nullptr) filter_insert(sv_input);
+		}
+	} catch (std::exception &e) {
+		throw std::runtime_error("Insertion failed: " + std::string(e.what()));
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
 void MstrieStructure::mstrie_delete(const std::vector<uint> &sv_input) {
-	std::shared_ptr<MstrieNode> root_p = std::move(_root);
-	std::shared_ptr<MstrieNode> parent = std::move(_root);
+	std::shared_ptr<MstrieNode> root_p = _root;
+	std::shared_ptr<MstrieNode> parent = _root;
 	int pos = 0;
 	int children;
 	try {
@@ -152,26 +328,58 @@ void MstrieStructure::mstrie_delete(const std::vector<uint> &sv_input) {
 			}
 			root_p = root_p->mult_switch->at(sv_input[i]);
 		}
+		if (frozen) {
+			/* Copy the path down to parent, it may be shared with a snapshot */
+			parent = writable(_root);
+			for (int i=0; i<pos; i++) {
+				parent = writable(parent->mult_switch->at(sv_input[i]));
+			}
+		}
 		parent->mult_switch->at(sv_input[pos]) = nullptr;
+		/* The cardinality bounds of the path above the removed branch may shrink */
+		std::vector<MstrieNode*> path (pos + 1, _root.get());
+		for (int i=0; i<pos; i++) {
+			path[i+1] = path[i]->mult_switch->at(sv_input[i]).get();
+		}
+		for (int i=pos; i>=0 && update_cardinality(path[i]); i--);
+		if (hash_index != nullptr) hash_index->erase(sv_input.data());
+		if (filter != nullptr) filter->erase(sv_input.data());
 		
-		statistics->total_number_of_nodes -= (_settings->alphabet - pos - 1);
+		statistics.total_number_of_nodes -= (_settings->alphabet - pos - 1);
 	} catch (std::exception &e) {
 		throw std::runtime_error("Deletion failed: " + std::string(e.what()));
 	}
-	statistics->total_number_of_multisets--;
+	statistics.total_number_of_multisets--;
 }
 
 // -----------------------------------------------------------------------------------------------
 
 bool MstrieStructure::mstrie_search(const std::vector<uint> &sv_input) {
-	std::shared_ptr<MstrieNode> root_p = std::move(_root);
+	// a missing multiset is rejected without reaching the trie, the trie reports too large multiplicities
+	if (filter != nullptr && !filter->contains(sv_input.data())
+		&& *std::max_element(sv_input.begin(), sv_input.end()) <= _settings->max_multiplicity) {
+		return false;
+	}
+	if (hash_index != nullptr) {
+		bool found;
+		try {
+			found = hash_index->contains(sv_input.data());
+		} catch (std::exception &e) {
+			throw std::runtime_error("Search failed: " + std::string(e.what()));
+		}
+		MSTRIE_PROFILE_RECORD(if (found) statistics.last_query_profile.results++);
+		return found;
+	}
+	std::shared_ptr<MstrieNode> root_p = _root;
 	int i = 0;
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.visited_nodes[0]++);
 	try {
 		while (i<_settings->alphabet) {
 			if (root_p->mult_switch->at(sv_input[i]) != nullptr) {
 				root_p = root_p->mult_switch->at(sv_input[i]);
 				++i;
-				statistics->last_query_traversed_nodes++;
+				if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters)) statistics.last_query_traversed_nodes++;
+				MSTRIE_PROFILE_RECORD(statistics.last_query_profile.visited_nodes[i]++);
 			}
 			else {
 				return false;
@@ -180,6 +388,7 @@ bool MstrieStructure::mstrie_search(const std::vector<uint> &sv_input) {
 	} catch (std::exception &e) {
 		throw std::runtime_error("Search failed: " + std::string(e.what()));
 	}
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.results++);
 	return true;
 }
 
@@ -189,21 +398,23 @@ bool MstrieStructure::mstrie_subseteq(const std::vector<uint> &sv_input, uint li
 {
 	try {
 		if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
-		std::shared_ptr<MstrieNode> root_p = std::move(_root);
+		std::shared_ptr<MstrieNode> root_p = _root;
 		return mstrie_subseteq_rec(root_p, sv_input, limit, 0);
 	} catch (std::exception &e) {
 		throw std::runtime_error("Sub multiset existence failed: " + std::string(e.what()));
 	}
 }
 bool MstrieStructure::mstrie_subseteq_rec(const std::shared_ptr<MstrieNode> root, const std::vector<uint> &sv_input, uint limit, uint vcnt){
-	statistics->last_query_traversed_nodes++;
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters)) statistics.last_query_traversed_nodes++;
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.visited_nodes[vcnt]++);
 	/* Check if we came to acceptor node */
 	if (root == _dummy) {
+		MSTRIE_PROFILE_RECORD(statistics.last_query_profile.results++);
 		return true;
 	}
 	
 	/* Find the closest subset */
-	for (uint i = sv_input[vcnt], lt = limit; (i >= 0 && lt >=0) ; i--, lt--) {
+	for (int i = sv_input[vcnt], lt = limit; (i >= 0 && lt >= 0) ; i--, lt--) {
 		if (root->mult_switch->at(i) != nullptr) {
 			/* Proceed search on next level */
 			if (mstrie_subseteq_rec(root->mult_switch->at(i), sv_input, limit, vcnt+1)) {
@@ -211,32 +422,38 @@ bool MstrieStructure::mstrie_subseteq_rec(const std::shared_ptr<MstrieNode> root
 			}
 		}
 	}
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.limit_pruned[vcnt] += count_children(root.get(), 0, (int)sv_input[vcnt] - (int)limit - 1));
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.dead_ends[vcnt]++);
 	return false;
 }
 
 // -----------------------------------------------------------------------------------------------
 
-std::queue<std::string> MstrieStructure::mstrie_get_subseteq(const std::vector<uint> &sv_input, uint limit){
+void MstrieStructure::mstrie_get_subseteq(const std::vector<uint> &sv_input, uint limit, std::vector<uint> &found, MstrieVisitor *visitor){
 	std::vector<uint> sv_out (_settings->alphabet);
-	std::queue<std::string> q;
 	try {
 		if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
-		std::shared_ptr<MstrieNode> root_p = std::move(_root);
-		mstrie_get_subseteq_rec(root_p, sv_input, sv_out, q, limit, 0);
+		std::shared_ptr<MstrieNode> root_p = _root;
+		if (visitor != nullptr)
+			mstrie_get_subseteq_rec(root_p, sv_input, sv_out, *visitor, limit, 0);
+		else
+			mstrie_get_subseteq_rec(root_p, sv_input, sv_out, found, limit, 0);
 	} catch (std::exception &e) {
 		throw std::runtime_error("Get sub multisets failed: " + std::string(e.what()));
 	}
-	return q;
 }
-void MstrieStructure::mstrie_get_subseteq_rec(const std::shared_ptr<MstrieNode> root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, std::queue<std::string> &str_que, uint limit, uint vcnt)
+template <typename Sink>
+bool MstrieStructure::mstrie_get_subseteq_rec(const std::shared_ptr<MstrieNode> root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, Sink &found, uint limit, uint vcnt)
 {
-	statistics->last_query_traversed_nodes++;
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters)) statistics.last_query_traversed_nodes++;
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.visited_nodes[vcnt]++);
 	/* Check if we came to acceptor node */
 	if (root == _dummy) {
-		/* Add vector to queue */
-		str_que.push(num_to_str(sv_output));
-		return;
+		MSTRIE_PROFILE_RECORD(statistics.last_query_profile.results++);
+		/* Add vector to found, the words are made after the traversal */
+		return add_found(found, sv_output);
 	}
+	MSTRIE_PROFILE_RECORD(unsigned long results = statistics.last_query_profile.results);
 	
 	/* Find the closest subset */
 	for (int i = sv_input[vcnt], lt = limit; (i >= 0 && lt >= 0) ; i--, lt--) {
@@ -244,10 +461,12 @@ void MstrieStructure::mstrie_get_subseteq_rec(const std::shared_ptr<MstrieNode>
 			/* Store multiplicity to vector */
 			sv_output[vcnt] = i;
 			/* Proceed search on next level */
-			mstrie_get_subseteq_rec(root->mult_switch->at(i), sv_input, sv_output, str_que, limit, vcnt+1);
+			if (!mstrie_get_subseteq_rec(root->mult_switch->at(i), sv_input, sv_output, found, limit, vcnt+1)) return false;
 		}
 	}
-	return;
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.limit_pruned[vcnt] += count_children(root.get(), 0, (int)sv_input[vcnt] - (int)limit - 1));
+	MSTRIE_PROFILE_RECORD(if (statistics.last_query_profile.results == results) statistics.last_query_profile.dead_ends[vcnt]++);
+	return true;
 }
 
 // -----------------------------------------------------------------------------------------------
@@ -256,16 +475,18 @@ bool MstrieStructure::mstrie_superseteq(const std::vector<uint> &sv_input, uint
 {
 	try {
 		if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
-		std::shared_ptr<MstrieNode> root_p = std::move(_root);
+		std::shared_ptr<MstrieNode> root_p = _root;
 		return mstrie_superseteq_rec(root_p, sv_input, limit, 0);
 	} catch (std::exception &e) {
 		throw std::runtime_error("Super multiset existence failed: " + std::string(e.what()));
 	}
 }
 bool MstrieStructure::mstrie_superseteq_rec(const std::shared_ptr<MstrieNode> root, const std::vector<uint> &sv_input, uint limit, uint vcnt) {
-	statistics->last_query_traversed_nodes++;
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters)) statistics.last_query_traversed_nodes++;
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.visited_nodes[vcnt]++);
 	/* Check if we came to acceptor node */
 	if (root == _dummy) {
+		MSTRIE_PROFILE_RECORD(statistics.last_query_profile.results++);
 		return true;
 	}
 	
@@ -278,32 +499,38 @@ bool MstrieStructure::mstrie_superseteq_rec(const std::shared_ptr<MstrieNode> ro
 			}
 		}
 	}
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.limit_pruned[vcnt] += count_children(root.get(), sv_input[vcnt] + limit + 1, _settings->max_multiplicity));
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.dead_ends[vcnt]++);
 	return false;
 }
 
 // -----------------------------------------------------------------------------------------------
 
-std::queue<std::string> MstrieStructure::mstrie_get_superseteq(const std::vector<uint> &sv_input, uint limit){
+void MstrieStructure::mstrie_get_superseteq(const std::vector<uint> &sv_input, uint limit, std::vector<uint> &found, MstrieVisitor *visitor){
 	std::vector<uint> sv_out (_settings->alphabet);
-	std::queue<std::string> q;
 	try {
 		if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
-		std::shared_ptr<MstrieNode> root_p = std::move(_root);
-		mstrie_get_superseteq_rec(root_p, sv_input, sv_out, q, limit, 0);
+		std::shared_ptr<MstrieNode> root_p = _root;
+		if (visitor != nullptr)
+			mstrie_get_superseteq_rec(root_p, sv_input, sv_out, *visitor, limit, 0);
+		else
+			mstrie_get_superseteq_rec(root_p, sv_input, sv_out, found, limit, 0);
 	} catch (std::exception &e) {
 		throw std::runtime_error("Get super multisets failed: " + std::string(e.what()));
 	}
-	return q;
 }
-void MstrieStructure::mstrie_get_superseteq_rec(const std::shared_ptr<MstrieNode> root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, std::queue<std::string> &str_que, uint limit, uint vcnt)
+template <typename Sink>
+bool MstrieStructure::mstrie_get_superseteq_rec(const std::shared_ptr<MstrieNode> root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, Sink &found, uint limit, uint vcnt)
 {
-	statistics->last_query_traversed_nodes++;
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters)) statistics.last_query_traversed_nodes++;
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.visited_nodes[vcnt]++);
 	/* Check if we came to acceptor node */
 	if (root == _dummy) {
-		/* Add vector to queue */
-		str_que.push(num_to_str(sv_output));
-		return;
+		MSTRIE_PROFILE_RECORD(statistics.last_query_profile.results++);
+		/* Add vector to found, the words are made after the traversal */
+		return add_found(found, sv_output);
 	}
+	MSTRIE_PROFILE_RECORD(unsigned long results = statistics.last_query_profile.results);
 	
 	/* Find the closest subset */
 	for (int i = sv_input[vcnt], lt = limit; (i <= _settings->max_multiplicity && lt >= 0) ; i++, lt--) {
@@ -311,12 +538,242 @@ void MstrieStructure::mstrie_get_superseteq_rec(const std::shared_ptr<MstrieNode
 			/* Store multiplicity to vector */
 			sv_output[vcnt] = i;
 			/* Proceed search on next level */
-			mstrie_get_superseteq_rec(root->mult_switch->at(i), sv_input, sv_output, str_que, limit, vcnt+1);
+			if (!mstrie_get_superseteq_rec(root->mult_switch->at(i), sv_input, sv_output, found, limit, vcnt+1)) return false;
+		}
+	}
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.limit_pruned[vcnt] += count_children(root.get(), sv_input[vcnt] + limit + 1, _settings->max_multiplicity));
+	MSTRIE_PROFILE_RECORD(if (statistics.last_query_profile.results == results) statistics.last_query_profile.dead_ends[vcnt]++);
+	return true;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::mstrie_get_bounded(const std::vector<uint> &sv_input, uint limit, bool sub, uint min_cardinality, uint max_cardinality, std::vector<uint> &found, MstrieVisitor *visitor){
+	std::vector<uint> sv_out (_settings->alphabet);
+	std::vector<uint> query_rest (_settings->alphabet + 1, 0);
+	for (uint i = _settings->alphabet; i-- > 0; ) {
+		query_rest[i] = query_rest[i+1] + sv_input[i];
+	}
+	try {
+		if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
+		if (visitor != nullptr)
+			mstrie_get_bounded_rec(_root.get(), sv_input, query_rest, sv_out, *visitor, limit, sub, min_cardinality, max_cardinality, 0, 0);
+		else
+			mstrie_get_bounded_rec(_root.get(), sv_input, query_rest, sv_out, found, limit, sub, min_cardinality, max_cardinality, 0, 0);
+	} catch (std::exception &e) {
+		throw std::runtime_error("Get multisets of bounded cardinality failed: " + std::string(e.what()));
+	}
+}
+template <typename Sink>
+bool MstrieStructure::mstrie_get_bounded_rec(const MstrieNode *root, const std::vector<uint> &sv_input, const std::vector<uint> &query_rest, std::vector<uint> &sv_output, Sink &found, uint limit, bool sub, uint min_cardinality, uint max_cardinality, uint cardinality, uint vcnt)
+{
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters)) statistics.last_query_traversed_nodes++;
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.visited_nodes[vcnt]++);
+	/* Check if we came to acceptor node, its cardinality was checked with the bounds */
+	if (root == _dummy.get()) {
+		MSTRIE_PROFILE_RECORD(statistics.last_query_profile.results++);
+		return add_found(found, sv_output);
+	}
+	MSTRIE_PROFILE_RECORD(unsigned long results = statistics.last_query_profile.results);
+	
+	/* Submultisets are at most and supermultisets at least the rest of the query */
+	uint low = sub ? 0 : query_rest[vcnt + 1];
+	uint high = sub ? query_rest[vcnt + 1] : MstrieNode::cardinality_unbounded;
+	int query = sv_input[vcnt];
+	int step = sub ? -1 : 1;
+	for (int i = query, lt = limit; ((sub ? i >= 0 : i <= (int)_settings->max_multiplicity) && lt >= 0); i += step, lt--) {
+		const MstrieNode *child = root->mult_switch->at(i).get();
+		if (child == nullptr) continue;
+		uint path = cardinality + i;
+		/* The cardinalities below the child, from the child and from the query */
+		uint below_min = std::max<uint>(child->min_cardinality, low);
+		bool below_unbounded = child->max_cardinality == MstrieNode::cardinality_unbounded && high == MstrieNode::cardinality_unbounded;
+		uint below_max = std::min<uint>(child->max_cardinality == MstrieNode::cardinality_unbounded ? high : child->max_cardinality, high);
+		if (path + below_min > max_cardinality || (!below_unbounded && (below_min > below_max || path + below_max < min_cardinality))) {
+			MSTRIE_PROFILE_RECORD(statistics.last_query_profile.limit_pruned[vcnt]++);
+			continue;
+		}
+		sv_output[vcnt] = i;
+		if (!mstrie_get_bounded_rec(child, sv_input, query_rest, sv_output, found, limit, sub, min_cardinality, max_cardinality, path, vcnt+1)) return false;
+	}
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.limit_pruned[vcnt] += sub ? count_children(root, 0, query - (int)limit - 1) : count_children(root, query + limit + 1, _settings->max_multiplicity));
+	MSTRIE_PROFILE_RECORD(if (statistics.last_query_profile.results == results) statistics.last_query_profile.dead_ends[vcnt]++);
+	return true;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::mstrie_get_extremal(const std::vector<uint> &sv_input, uint limit, bool sub, std::vector<uint> &found){
+	std::vector<uint> sv_out (_settings->alphabet);
+	std::vector<uint> equal_from;
+	try {
+		if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
+		mstrie_get_extremal_rec(_root.get(), sv_input, sv_out, found, equal_from, std::vector<size_t>(), limit, sub, 0);
+	} catch (std::exception &e) {
+		throw std::runtime_error("Get extremal multisets failed: " + std::string(e.what()));
+	}
+}
+void MstrieStructure::mstrie_get_extremal_rec(const MstrieNode *root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, std::vector<uint> &found, std::vector<uint> &equal_from, const std::vector<size_t> &dominating, uint limit, bool sub, uint vcnt)
+{
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters)) statistics.last_query_traversed_nodes++;
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.visited_nodes[vcnt]++);
+	/* Check if we came to acceptor node, no found multiset covers it */
+	if (root == _dummy.get()) {
+		found.insert(found.end(), sv_output.begin(), sv_output.end());
+		uint level = _settings->alphabet;
+		while (level > 0 && sv_output[level-1] == sv_input[level-1]) level--;
+		equal_from.push_back(level);
+		MSTRIE_PROFILE_RECORD(statistics.last_query_profile.results++);
+		return;
+	}
+	MSTRIE_PROFILE_RECORD(size_t results = found.size());
+	
+	/* The children are visited from the query multiplicity on, so the multisets found
+	 * below the previous children cover the path of every following child
+	 */
+	size_t first_new = equal_from.size();
+	std::vector<size_t> child_dominating;
+	int step = sub ? -1 : 1;
+	for (int i = sv_input[vcnt], lt = limit; ((sub ? i >= 0 : i <= (int)_settings->max_multiplicity) && lt >= 0); i += step, lt--) {
+		const MstrieNode *child = root->mult_switch->at(i).get();
+		if (child == nullptr) continue;
+		child_dominating.clear();
+		for (auto m : dominating) {
+			uint multiplicity = found[m * _settings->alphabet + vcnt];
+			if (sub ? multiplicity >= (uint)i : multiplicity <= (uint)i) child_dominating.push_back(m);
+		}
+		for (size_t m = first_new; m < equal_from.size(); m++) {
+			child_dominating.push_back(m);
+		}
+		/* A covering multiset that equals the query below covers the whole subtree */
+		bool covered = false;
+		for (auto m : child_dominating) {
+			if (equal_from[m] <= vcnt + 1) {
+				covered = true;
+				break;
+			}
+		}
+		if (covered) {
+			MSTRIE_PROFILE_RECORD(statistics.last_query_profile.limit_pruned[vcnt]++);
+			continue;
+		}
+		sv_output[vcnt] = i;
+		mstrie_get_extremal_rec(child, sv_input, sv_output, found, equal_from, child_dominating, limit, sub, vcnt+1);
+	}
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.limit_pruned[vcnt] += sub ? count_children(root, 0, (int)sv_input[vcnt] - (int)limit - 1) : count_children(root, sv_input[vcnt] + limit + 1, _settings->max_multiplicity));
+	MSTRIE_PROFILE_RECORD(if (found.size() == results) statistics.last_query_profile.dead_ends[vcnt]++);
+	return;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::mstrie_get_within(const std::vector<uint> &sv_input, uint budget, bool below, bool above, std::vector<uint> &found){
+	std::vector<uint> sv_out (_settings->alphabet);
+	/* No stored multiset is farther from the query than its multiplicities or the highest
+	 * multiplicity on every level, alphabet * max_multiplicity for a valid query */
+	uint64_t farthest = 0;
+	for (uint i = 0; i < _settings->alphabet; i++) {
+		farthest += std::max(sv_input[i], _settings->max_multiplicity);
+	}
+	budget = static_cast<uint>(std::min<uint64_t>(budget, farthest));
+	try {
+		mstrie_get_within_rec(_root.get(), sv_input, sv_out, found, budget, below, above, 0);
+	} catch (std::exception &e) {
+		throw std::runtime_error("Get multisets within distance failed: " + std::string(e.what()));
+	}
+}
+void MstrieStructure::mstrie_get_within_rec(const MstrieNode *root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, std::vector<uint> &found, uint budget, bool below, bool above, uint vcnt)
+{
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters)) statistics.last_query_traversed_nodes++;
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.visited_nodes[vcnt]++);
+	/* Check if we came to acceptor node */
+	if (root == _dummy.get()) {
+		found.insert(found.end(), sv_output.begin(), sv_output.end());
+		MSTRIE_PROFILE_RECORD(statistics.last_query_profile.results++);
+		return;
+	}
+	MSTRIE_PROFILE_RECORD(size_t results = found.size());
+	
+	/* The multiplicities the remaining budget reaches, the budget is shared by all levels;
+	 * the range is taken in 64 bits and is empty for a query above the highest multiplicity */
+	int64_t query = sv_input[vcnt];
+	int max_multiplicity = _settings->max_multiplicity;
+	int from = static_cast<int>(std::min<int64_t>(below ? std::max<int64_t>(0, query - budget) : query, max_multiplicity + 1));
+	int to = static_cast<int>(std::min<int64_t>(max_multiplicity, above ? query + budget : query));
+	for (int i = from; i <= to; i++) {
+		const MstrieNode *child = root->mult_switch->at(i).get();
+		if (child != nullptr) {
+			sv_output[vcnt] = i;
+			mstrie_get_within_rec(child, sv_input, sv_output, found, budget - std::abs(i - query), below, above, vcnt+1);
 		}
 	}
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.limit_pruned[vcnt] += count_children(root, 0, from - 1) + count_children(root, std::max(from, to + 1), max_multiplicity));
+	MSTRIE_PROFILE_RECORD(if (found.size() == results) statistics.last_query_profile.dead_ends[vcnt]++);
 	return;
 }
 
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::mstrie_get_nearest(const std::vector<uint> &sv_input, uint k, const std::vector<uint> &weights, std::vector<uint> &found, std::vector<uint64_t> &distances){
+	if (k == 0) return;
+	std::vector<uint> sv_out (_settings->alphabet);
+	MstrieNearest nearest;
+	try {
+		mstrie_get_nearest_rec(_root.get(), sv_input, weights, sv_out, nearest, k, 0, 0);
+	} catch (std::exception &e) {
+		throw std::runtime_error("Get nearest multisets failed: " + std::string(e.what()));
+	}
+	/* The worst multiset is on top, fill the results from the end */
+	size_t n = nearest.size();
+	found.resize(found.size() + n * _settings->alphabet);
+	distances.resize(distances.size() + n);
+	for (size_t i = n; i > 0; i--) {
+		std::copy(nearest.top().second.begin(), nearest.top().second.end(), found.end() - (n - i + 1) * _settings->alphabet);
+		distances[distances.size() - (n - i + 1)] = nearest.top().first;
+		nearest.pop();
+	}
+}
+void MstrieStructure::mstrie_get_nearest_rec(const MstrieNode *root, const std::vector<uint> &sv_input, const std::vector<uint> &weights, std::vector<uint> &sv_output, MstrieNearest &nearest, uint k, uint64_t distance, uint vcnt)
+{
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters)) statistics.last_query_traversed_nodes++;
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.visited_nodes[vcnt]++);
+	/* Check if we came to acceptor node */
+	if (root == _dummy.get()) {
+		if (nearest.size() < k) {
+			nearest.emplace(distance, sv_output);
+		}
+		else if (distance < nearest.top().first || (distance == nearest.top().first && sv_output < nearest.top().second)) {
+			nearest.pop();
+			nearest.emplace(distance, sv_output);
+		}
+		MSTRIE_PROFILE_RECORD(statistics.last_query_profile.results++);
+		return;
+	}
+	
+	/* Visit the children by their distance from the query multiplicity, the nearest first */
+	uint64_t weight = weights.empty() ? 1 : weights[vcnt];
+	int query = sv_input[vcnt];
+	int max_multiplicity = _settings->max_multiplicity;
+	for (int offset = 0; query - offset >= 0 || query + offset <= max_multiplicity; offset++) {
+		uint64_t bound = distance + weight * offset;
+		/* The remaining levels add no distance at best, the farther children cannot do better */
+		if (nearest.size() == k && bound > nearest.top().first) {
+			MSTRIE_PROFILE_RECORD(statistics.last_query_profile.limit_pruned[vcnt] += count_children(root, 0, query - offset) + count_children(root, query + std::max(offset, 1), max_multiplicity));
+			break;
+		}
+		const int multiplicities[2] = { query - offset, query + offset };
+		for (int c = 0; c < (offset == 0 ? 1 : 2); c++) {
+			int i = multiplicities[c];
+			if (i < 0 || i > max_multiplicity) continue;
+			const MstrieNode *child = root->mult_switch->at(i).get();
+			if (child != nullptr) {
+				sv_output[vcnt] = i;
+				mstrie_get_nearest_rec(child, sv_input, weights, sv_output, nearest, k, bound, vcnt+1);
+			}
+		}
+	}
+	return;
+}
 
 // ===============================================================================================
 // ===============================================================================================
@@ -326,13 +783,56 @@ void MstrieStructure::mstrie_get_superseteq_rec(const std::shared_ptr<MstrieNode
  * Read / Write utilities
  * ------------------------------------------------------------------
  */
-void MstrieStructure::load_mstrie(const std::string &content) {
-	std::stringstream ss(content);
-	std::string token, temp;
-	std::getline(ss, token, '\n'); // skip signature
-	std::getline(ss, token, '\n'); // read the structural parameters
+unsigned long long MstrieStructure::load_mstrie(const std::string &content) {
+	return load_mstrie(content.data(), content.size());
+}
+
+unsigned long long MstrieStructure::load_mstrie(const char *content, size_t size, uint threads) {
+	// the filter is not updated by the loaded multisets, a restored one already holds them
+	// and an empty one is built once at its final size
+	std::unique_ptr<MstrieCuckooFilter> detached = std::move(filter);
+	bool restored = filter_restored;
+	filter_restored = false;
+	unsigned long long checkpoint_lsn;
+	try {
+		if (MstrieCompressedFormat::detect(content, size)) {
+			checkpoint_lsn = load_compressed_mstrie(content, size);
+		}
+		else {
+			checkpoint_lsn = load_plain_mstrie(content, size, threads);
+		}
+	} catch (std::exception &e) {
+		filter = std::move(detached);
+		throw;
+	}
+	filter = std::move(detached);
+	if (filter != nullptr && !(restored && filter->size() == static_cast<size_t>(statistics.total_number_of_multisets))) {
+		rebuild_filter(MstrieCuckooFilter::buckets_for(statistics.total_number_of_multisets));
+	}
+	return checkpoint_lsn;
+}
+
+unsigned long long MstrieStructure::load_plain_mstrie(const char *content, size_t size, uint threads) {
+	const char *content_end = content + size;
+	auto read_line = [&content, content_end]() {
+		const char *line_end = static_cast<const char*>(memchr(content, '\n', content_end - content));
+		if (line_end == nullptr) line_end = content_end;
+		std::string line(content, line_end);
+		content = (line_end == content_end) ? content_end : line_end + 1;
+		return line;
+	};
+	std::string temp;
+	
+	// read signature: timestamp and optional checkpoint lsn
+	unsigned long long checkpoint_lsn = 0;
+	std::stringstream signature(read_line());
+	std::getline(signature, temp, ' ');
+	if (std::getline(signature, temp, ' ')) {
+		checkpoint_lsn = std::stoull(temp);
+	}
 	
-	std::stringstream params(token);
+	// read the structural parameters
+	std::stringstream params(read_line());
 	std::getline(params, temp, ' ');
 	uint used_max_multiplicity = std::stoi(temp);
 	std::getline(params, temp, '\n');
@@ -341,38 +841,196 @@ void MstrieStructure::load_mstrie(const std::string &content) {
 	if (used_alphabet_size != _settings->alphabet || used_max_multiplicity != _settings->max_multiplicity) {
 		throw MstrieException("Mstrie parametrization is not correct.\nThe mstrie you are trying to load is parametrized as follows:\n\talphabet_size="+std::to_string(_settings->alphabet)+"\n\tmax_multiplicity="+std::to_string(_settings->max_multiplicity));
 	}
-	while (std::getline(ss, token, '\n')) {
-		auto v = str_to_num(token);
-		mstrie_insert(v);
+	
+	MstrieLoader loader(_settings->alphabet, _settings->max_multiplicity, threads);
+	loader.parse(content, content_end - content, [this](const MstrieBatch &batch) {
+		for (size_t i = 0; i < batch.size(); i++) {
+			mstrie_insert(batch.at(i));
+		}
+	});
+	return checkpoint_lsn;
+}
+
+unsigned long long MstrieStructure::load_compressed_mstrie(const char *content, size_t size) {
+	const char *content_end = content + size;
+	content += MstrieCompressedFormat::magic.size();
+	
+	MstrieCompressedFormat::read_varint(content, content_end); // skip timestamp
+	unsigned long long checkpoint_lsn = MstrieCompressedFormat::read_varint(content, content_end);
+	auto used_max_multiplicity = MstrieCompressedFormat::read_varint(content, content_end);
+	auto used_alphabet_size = MstrieCompressedFormat::read_varint(content, content_end);
+	
+	if (used_alphabet_size != _settings->alphabet || used_max_multiplicity != _settings->max_multiplicity) {
+		throw MstrieException("Mstrie parametrization is not correct.\nThe mstrie you are trying to load is parametrized as follows:\n\talphabet_size="+std::to_string(_settings->alphabet)+"\n\tmax_multiplicity="+std::to_string(_settings->max_multiplicity));
+	}
+	
+	std::vector<uint> sv_input (_settings->alphabet, 0);
+	// the nodes of the previous multiset, level by level
+	std::vector<MstrieNode*> path (_settings->alphabet, nullptr);
+	path[0] = _root.get();
+	// the first multiset shares nothing
+	uint valid_prefix = 0;
+	while (content < content_end) {
+		auto shared_prefix = MstrieCompressedFormat::read_varint(content, content_end);
+		if (shared_prefix > valid_prefix || shared_prefix >= _settings->alphabet) {
+			throw MstrieException("Corrupted compressed mstrie: unexpected shared prefix " + std::to_string(shared_prefix) + ".");
+		}
+		for (uint i = shared_prefix; i < _settings->alphabet; i++) {
+			sv_input[i] = MstrieCompressedFormat::read_varint(content, content_end);
+		}
+		mstrie_insert_from(sv_input.data(), shared_prefix, path);
+		valid_prefix = _settings->alphabet - 1;
+	}
+	return checkpoint_lsn;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::retrieve_mstrie(unsigned long long checkpoint_lsn){
+	return prepare_mstrie_dump(_root.get(), checkpoint_lsn, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::retrieve_snapshot(const MstrieSnapshot &snapshot, unsigned long long checkpoint_lsn, std::atomic<unsigned long> *progress) const {
+	return prepare_mstrie_dump(snapshot.root.get(), checkpoint_lsn, progress);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::filter_insert(const uint *sv_input) {
+	if (!filter->insert(sv_input)) {
+		rebuild_filter(filter->bucket_count() * 2);
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::rebuild_filter(size_t buckets) {
+	uint bits = filter->fingerprint_bits();
+	std::vector<uint> sv_out (_settings->alphabet, 0);
+	// a full filter is rare with the load of buckets_for, it is started over twice as large
+	do {
+		filter = std::make_unique<MstrieCuckooFilter>(_settings->alphabet, bits, buckets);
+		buckets *= 2;
+	} while (!rebuild_filter_rec(_root.get(), sv_out, 0));
+}
+
+bool MstrieStructure::rebuild_filter_rec(const MstrieNode *root, std::vector<uint> &sv_output, uint vcnt) {
+	for (uint j = 0; j <= _settings->max_multiplicity; j++) {
+		const MstrieNode *child = root->mult_switch->at(j).get();
+		if (child == nullptr) continue;
+		sv_output[vcnt] = j;
+		if (child == _dummy.get()) {
+			if (!filter->insert(sv_output.data())) return false;
+		}
+		else if (!rebuild_filter_rec(child, sv_output, vcnt + 1)) {
+			return false;
+		}
 	}
+	return true;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::shared_ptr<MstrieCuckooFilter> MstrieStructure::copy_filter() const {
+	return filter != nullptr ? std::make_shared<MstrieCuckooFilter>(*filter) : nullptr;
 }
 
 // -----------------------------------------------------------------------------------------------
 
-std::string MstrieStructure::retrieve_mstrie(){
-	std::vector<uint> v = std::vector<uint> (_settings->alphabet, 0);
-	std::queue<std::string> q = mstrie_get_superseteq(v, _settings->max_multiplicity);
-	return prepare_mstrie_dump(q);
+void MstrieStructure::restore_filter(std::unique_ptr<MstrieCuckooFilter> restored) {
+	if (filter == nullptr || restored == nullptr) return;
+	filter = std::move(restored);
+	filter_restored = true;
 }
 
 // -----------------------------------------------------------------------------------------------
 
-std::string MstrieStructure::prepare_mstrie_dump(std::queue<std::string> queue){
-	// add timestamp to content
+std::string MstrieStructure::prepare_mstrie_dump(const MstrieNode *root, unsigned long long checkpoint_lsn, std::atomic<unsigned long> *progress) const {
+	std::vector<uint> sv_out (_settings->alphabet);
+	if (_settings->compressed_format) {
+		std::string content = MstrieCompressedFormat::magic;
+		MstrieCompressedFormat::append_varint(content, std::stoull(timestamp_string()));
+		MstrieCompressedFormat::append_varint(content, checkpoint_lsn);
+		MstrieCompressedFormat::append_varint(content, _settings->max_multiplicity);
+		MstrieCompressedFormat::append_varint(content, _settings->alphabet);
+		uint shared_prefix = 0;
+		prepare_compressed_dump_rec(root, sv_out, content, progress, 0, shared_prefix);
+		return content;
+	}
+	// add timestamp and checkpoint lsn to content
 	std::string content = timestamp_string();
-	content += '\n';
+	content += ' ' + std::to_string(checkpoint_lsn) + '\n';
 	content += std::to_string(_settings->max_multiplicity) + ' ' + std::to_string(_settings->alphabet) + '\n';
-	while (!queue.empty()) {
-		content.append(queue.front());
+	prepare_mstrie_dump_rec(root, sv_out, content, progress, 0);
+	return content;
+}
+void MstrieStructure::prepare_mstrie_dump_rec(const MstrieNode *root, std::vector<uint> &sv_output, std::string &content, std::atomic<unsigned long> *progress, uint vcnt) const {
+	/* Check if we came to acceptor node */
+	if (root == _dummy.get()) {
+		append_num_str(sv_output.data(), sv_output.size(), content);
 		content += '\n';
-		queue.pop();
+		if (progress != nullptr) {
+			progress->fetch_add(1, std::memory_order_relaxed);
+		}
+		return;
 	}
-	return content;
+	
+	/* Multisets are written in the order of the supermultiset retrieval of the empty multiset */
+	for (uint i = 0; i <= _settings->max_multiplicity; i++) {
+		const MstrieNode *child = root->mult_switch->at(i).get();
+		if (child != nullptr) {
+			sv_output[vcnt] = i;
+			prepare_mstrie_dump_rec(child, sv_output, content, progress, vcnt+1);
+		}
+	}
+}
+
+void MstrieStructure::prepare_compressed_dump_rec(const MstrieNode *root, std::vector<uint> &sv_output, std::string &content, std::atomic<unsigned long> *progress, uint vcnt, uint &shared_prefix) const {
+	/* Check if we came to acceptor node */
+	if (root == _dummy.get()) {
+		MstrieCompressedFormat::append_varint(content, shared_prefix);
+		for (uint i = shared_prefix; i < _settings->alphabet; i++) {
+			MstrieCompressedFormat::append_varint(content, sv_output[i]);
+		}
+		// nothing has changed for the next multiset yet
+		shared_prefix = _settings->alphabet;
+		if (progress != nullptr) {
+			progress->fetch_add(1, std::memory_order_relaxed);
+		}
+		return;
+	}
+	
+	for (uint i = 0; i <= _settings->max_multiplicity; i++) {
+		const MstrieNode *child = root->mult_switch->at(i).get();
+		if (child != nullptr) {
+			sv_output[vcnt] = i;
+			// the levels from vcnt on differ from the previous multiset
+			if (vcnt < shared_prefix) shared_prefix = vcnt;
+			prepare_compressed_dump_rec(child, sv_output, content, progress, vcnt+1, shared_prefix);
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::shared_ptr<MstrieSnapshot> MstrieStructure::freeze() {
+	auto snapshot = std::make_shared<MstrieSnapshot>(_root, statistics.total_number_of_multisets);
+	epoch++;
+	frozen = true;
+	return snapshot;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::release_snapshots() {
+	frozen = false;
 }
 
 // -----------------------------------------------------------------------------------------------
 
-std::string MstrieStructure::timestamp_string(){
+std::string MstrieStructure::timestamp_string() const {
 	auto t = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 	return std::to_string(t);
 }
@@ -380,22 +1038,56 @@ std::string MstrieStructure::timestamp_string(){
 // ===============================================================================================
 // ===============================================================================================
 
+/* ------------------------------------------------------------------
+ * Query statistics
+ * ------------------------------------------------------------------
+ */
+void MstrieStructure::begin_query(const char *name, int limit) {
+	MSTRIE_PROFILE_RECORD(statistics.last_query_profile.reset());
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters)) {
+		statistics.last_query_traversed_nodes = 0;
+	}
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::full)) {
+		statistics.last_query_time_taken = 0;
+		statistics.last_query_name = name;
+		if (limit >= 0) statistics.last_query_name += "_" + std::to_string(limit);
+		statistics.set_start_time();
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::end_query() {
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::full)) {
+		statistics.set_end_time();
+		statistics.set_last_query_time();
+	}
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
 /* ------------------------------------------------------------------
  * Public search queries
  * ------------------------------------------------------------------
  */
 bool MstrieStructure::pub_mstrie_search(const std::string &word){
-	statistics->reset();
-	statistics->last_query_name = "search exact";
-	statistics->set_start_time();
+	begin_query("search exact");
 	bool result;
+	// reused to avoid an allocation per query, per thread as queries may run concurrently
+	static thread_local std::vector<uint> search_input;
 	try {
-		result = mstrie_search(str_to_num(word));
+		{
+			TraceSpan span("parse");
+			search_input.resize(_settings->alphabet);
+			MstrieLoader::parse_multiset(word.data(), word.data() + word.size(), _settings->alphabet, _settings->max_multiplicity, search_input.data());
+		}
+		TraceSpan span("traversal");
+		result = mstrie_search(search_input);
 	} catch (std::exception &e) {
 		throw;
 	}
-	statistics->set_end_time();
-	statistics->set_last_query_time();
+	end_query();
 	return result;
 }
 
@@ -405,18 +1097,21 @@ bool MstrieStructure::pub_mstrie_subseteq(const std::string &word) {
 	return this->pub_mstrie_subseteq(word, _settings->max_multiplicity);
 }
 bool MstrieStructure::pub_mstrie_subseteq(const std::string &word, uint limit){
-	statistics->reset();
-	statistics->last_query_name = "search sub";
-	statistics->set_start_time();
+	begin_query("search sub");
 	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
 	bool result;
 	try {
-		result = mstrie_subseteq(str_to_num(word), limit);
+		std::vector<uint> sv_input;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+		}
+		TraceSpan span("traversal");
+		result = mstrie_subseteq(sv_input, limit);
 	} catch (std::exception &e) {
 		throw;
 	}
-	statistics->set_end_time();
-	statistics->set_last_query_time();
+	end_query();
 	return result;
 }
 
@@ -426,18 +1121,21 @@ bool MstrieStructure::pub_mstrie_superseteq(const std::string &word) {
 	return this->pub_mstrie_superseteq(word, _settings->max_multiplicity);
 }
 bool MstrieStructure::pub_mstrie_superseteq(const std::string &word, uint limit){
-	statistics->reset();
-	statistics->last_query_name = "search sup";
-	statistics->set_start_time();
+	begin_query("search sup");
 	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
 	bool result;
 	try {
-		result = mstrie_superseteq(str_to_num(word), limit);
+		std::vector<uint> sv_input;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+		}
+		TraceSpan span("traversal");
+		result = mstrie_superseteq(sv_input, limit);
 	} catch (std::exception &e) {
 		throw;
 	}
-	statistics->set_end_time();
-	statistics->set_last_query_time();
+	end_query();
 	return result;
 }
 
@@ -452,28 +1150,51 @@ std::string MstrieStructure::pub_mstrie_get_subseteq(const std::string &word){
 	return this->pub_mstrie_get_subseteq(word, _settings->max_multiplicity);
 }
 std::string MstrieStructure::pub_mstrie_get_subseteq(const std::string &word, uint limit){
-	statistics->reset();
-	statistics->last_query_name = "retrieve sub_" + std::to_string(limit);
-	statistics->set_start_time();
+	begin_query("retrieve sub", limit);
 	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
 	std::string output;
 	try {
-		auto q = mstrie_get_subseteq(str_to_num(word), limit);
-		if (q.empty()){
-			output = "";
+		std::vector<uint> sv_input;
+		std::vector<uint> found;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
 		}
-		else {
-			while (!q.empty()) {
-				output.append(q.front() + "|");
-				q.pop();
-			}
-			output = output.substr(0, output.size() -1);
+		{
+			TraceSpan span("traversal");
+			mstrie_get_subseteq(sv_input, limit, found);
 		}
+		TraceSpan span("format");
+		output = join_found(found);
 	} catch (std::exception &e) {
 		throw;
 	}
-	statistics->set_end_time();
-	statistics->set_last_query_time();
+	end_query();
+	return output;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::pub_mstrie_get_subseteq(const std::string &word, uint limit, uint min_cardinality, uint max_cardinality){
+	begin_query("retrieve sub bounded", limit);
+	std::string output;
+	try {
+		std::vector<uint> sv_input;
+		std::vector<uint> found;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+		}
+		{
+			TraceSpan span("traversal");
+			mstrie_get_bounded(sv_input, limit, true, min_cardinality, max_cardinality, found);
+		}
+		TraceSpan span("format");
+		output = join_found(found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
 	return output;
 }
 
@@ -483,28 +1204,210 @@ std::string MstrieStructure::pub_mstrie_get_superseteq(const std::string &word){
 	return this->pub_mstrie_get_superseteq(word, _settings->max_multiplicity);
 }
 std::string MstrieStructure::pub_mstrie_get_superseteq(const std::string &word, uint limit){
-	statistics->reset();
-	statistics->last_query_name = "retrieve sup_" + std::to_string(limit);
-	statistics->set_start_time();
+	begin_query("retrieve sup", limit);
 	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
 	std::string output;
 	try {
-		auto q = mstrie_get_superseteq(str_to_num(word), limit);
-		if (q.empty()){
-			output = "";
+		std::vector<uint> sv_input;
+		std::vector<uint> found;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
 		}
-		else {
-			while (!q.empty()) {
-				output.append(q.front() + "|");
-				q.pop();
-			}
-			output = output.substr(0, output.size() -1);
+		{
+			TraceSpan span("traversal");
+			mstrie_get_superseteq(sv_input, limit, found);
+		}
+		TraceSpan span("format");
+		output = join_found(found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+	return output;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::pub_mstrie_get_superseteq(const std::string &word, uint limit, uint min_cardinality, uint max_cardinality){
+	begin_query("retrieve sup bounded", limit);
+	std::string output;
+	try {
+		std::vector<uint> sv_input;
+		std::vector<uint> found;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+		}
+		{
+			TraceSpan span("traversal");
+			mstrie_get_bounded(sv_input, limit, false, min_cardinality, max_cardinality, found);
+		}
+		TraceSpan span("format");
+		output = join_found(found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+	return output;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::pub_mstrie_get_maximal_subseteq(const std::string &word, uint limit){
+	begin_query("retrieve maximal sub", limit);
+	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
+	std::string output;
+	try {
+		std::vector<uint> sv_input;
+		std::vector<uint> found;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+		}
+		{
+			TraceSpan span("traversal");
+			mstrie_get_extremal(sv_input, limit, true, found);
+		}
+		TraceSpan span("format");
+		output = join_found(found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+	return output;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::pub_mstrie_get_minimal_superseteq(const std::string &word, uint limit){
+	begin_query("retrieve minimal sup", limit);
+	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
+	std::string output;
+	try {
+		std::vector<uint> sv_input;
+		std::vector<uint> found;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+		}
+		{
+			TraceSpan span("traversal");
+			mstrie_get_extremal(sv_input, limit, false, found);
+		}
+		TraceSpan span("format");
+		output = join_found(found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+	return output;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::pub_mstrie_get_within(const std::string &word, uint distance){
+	begin_query("retrieve within", distance);
+	std::string output;
+	try {
+		std::vector<uint> sv_input;
+		std::vector<uint> found;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+		}
+		{
+			TraceSpan span("traversal");
+			mstrie_get_within(sv_input, distance, true, true, found);
+		}
+		TraceSpan span("format");
+		output = join_found(found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+	return output;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::pub_mstrie_get_subseteq_within(const std::string &word, uint distance){
+	begin_query("retrieve sub within", distance);
+	std::string output;
+	try {
+		std::vector<uint> sv_input;
+		std::vector<uint> found;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+		}
+		{
+			TraceSpan span("traversal");
+			mstrie_get_within(sv_input, distance, true, false, found);
+		}
+		TraceSpan span("format");
+		output = join_found(found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+	return output;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::pub_mstrie_get_superseteq_within(const std::string &word, uint distance){
+	begin_query("retrieve sup within", distance);
+	std::string output;
+	try {
+		std::vector<uint> sv_input;
+		std::vector<uint> found;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+		}
+		{
+			TraceSpan span("traversal");
+			mstrie_get_within(sv_input, distance, false, true, found);
+		}
+		TraceSpan span("format");
+		output = join_found(found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+	return output;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::pub_mstrie_get_nearest(const std::string &word, uint k, const std::string &weights){
+	begin_query("retrieve nearest");
+	std::string output;
+	try {
+		std::vector<uint> sv_input;
+		std::vector<uint> sv_weights;
+		std::vector<uint> found;
+		std::vector<uint64_t> distances;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+			sv_weights = parse_weights(weights);
+		}
+		{
+			TraceSpan span("traversal");
+			mstrie_get_nearest(sv_input, k, sv_weights, found, distances);
+		}
+		TraceSpan span("format");
+		for (size_t i = 0; i < distances.size(); i++) {
+			if (i > 0) output += '|';
+			append_num_str(found.data() + i * _settings->alphabet, _settings->alphabet, output);
+			output += " (" + std::to_string(distances[i]) + ")";
 		}
 	} catch (std::exception &e) {
 		throw;
 	}
-	statistics->set_end_time();
-	statistics->set_last_query_time();
+	end_query();
 	return output;
 }
 
@@ -516,56 +1419,534 @@ std::string MstrieStructure::pub_mstrie_get_superseteq(const std::string &word,
  * ------------------------------------------------------------------
  */
 void MstrieStructure::pub_mstrie_insert(const std::string &word){
-	statistics->reset();
-	statistics->last_query_name = "insert";
-	statistics->set_start_time();
+	begin_query("insert");
 	try {
-		mstrie_insert(str_to_num(word));
+		std::vector<uint> sv_input;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+		}
+		TraceSpan span("update");
+		mstrie_insert(sv_input.data());
 	} catch (std::exception &e) {
 		throw;
 	}
-	statistics->set_end_time();
-	statistics->set_last_query_time();
+	end_query();
 }
 
 // -----------------------------------------------------------------------------------------------
 
 void MstrieStructure::pub_mstrie_delete(const std::string &word){
-	statistics->reset();
-	statistics->last_query_name = "delete";
-	statistics->set_start_time();
+	begin_query("delete");
 	try {
-		mstrie_delete(str_to_num(word));
+		std::vector<uint> sv_input;
+		{
+			TraceSpan span("parse");
+			sv_input = str_to_num(word);
+		}
+		TraceSpan span("update");
+		mstrie_delete(sv_input);
 	} catch (std::exception &e) {
 		throw;
 	}
-	statistics->set_end_time();
-	statistics->set_last_query_time();
+	end_query();
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+/* ------------------------------------------------------------------
+ * Public queries on multiplicity vectors
+ * ------------------------------------------------------------------
+ */
+void MstrieStructure::check_vector(const std::vector<uint> &v) const {
+	if (v.size() != _settings->alphabet) {
+		throw MstrieException("Multiplicity vector must have " + std::to_string(_settings->alphabet) + " elements.");
+	}
+	for (auto m : v) {
+		if (m > _settings->max_multiplicity) {
+			throw MstrieException("Multiplicity cannot be greater than " + std::to_string(_settings->max_multiplicity) + ".");
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::pub_mstrie_insert(const std::vector<uint> &v){
+	begin_query("insert");
+	try {
+		check_vector(v);
+		TraceSpan span("update");
+		mstrie_insert(v.data());
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::pub_mstrie_delete(const std::vector<uint> &v){
+	begin_query("delete");
+	try {
+		check_vector(v);
+		TraceSpan span("update");
+		mstrie_delete(v);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieStructure::pub_mstrie_search(const std::vector<uint> &v){
+	begin_query("search exact");
+	bool result;
+	try {
+		check_vector(v);
+		TraceSpan span("traversal");
+		result = mstrie_search(v);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+	return result;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieStructure::pub_mstrie_subseteq(const std::vector<uint> &v, uint limit){
+	begin_query("search sub");
+	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
+	bool result;
+	try {
+		check_vector(v);
+		TraceSpan span("traversal");
+		result = mstrie_subseteq(v, limit);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+	return result;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieStructure::pub_mstrie_superseteq(const std::vector<uint> &v, uint limit){
+	begin_query("search sup");
+	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
+	bool result;
+	try {
+		check_vector(v);
+		TraceSpan span("traversal");
+		result = mstrie_superseteq(v, limit);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+	return result;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::pub_mstrie_get_subseteq(const std::vector<uint> &v, uint limit, std::vector<uint> &found){
+	begin_query("retrieve sub", limit);
+	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
+	try {
+		check_vector(v);
+		TraceSpan span("traversal");
+		mstrie_get_subseteq(v, limit, found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::pub_mstrie_get_superseteq(const std::vector<uint> &v, uint limit, std::vector<uint> &found){
+	begin_query("retrieve sup", limit);
+	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
+	try {
+		check_vector(v);
+		TraceSpan span("traversal");
+		mstrie_get_superseteq(v, limit, found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::pub_mstrie_get_subseteq(const std::vector<uint> &v, uint limit, uint min_cardinality, uint max_cardinality, std::vector<uint> &found){
+	begin_query("retrieve sub bounded", limit);
+	try {
+		check_vector(v);
+		TraceSpan span("traversal");
+		mstrie_get_bounded(v, limit, true, min_cardinality, max_cardinality, found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::pub_mstrie_get_superseteq(const std::vector<uint> &v, uint limit, uint min_cardinality, uint max_cardinality, std::vector<uint> &found){
+	begin_query("retrieve sup bounded", limit);
+	try {
+		check_vector(v);
+		TraceSpan span("traversal");
+		mstrie_get_bounded(v, limit, false, min_cardinality, max_cardinality, found);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::pub_mstrie_get_subseteq(const std::vector<uint> &v, uint limit, MstrieVisitor &visitor){
+	begin_query("retrieve sub", limit);
+	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
+	try {
+		check_vector(v);
+		TraceSpan span("traversal");
+		std::vector<uint> found;
+		mstrie_get_subseteq(v, limit, found, &visitor);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::pub_mstrie_get_superseteq(const std::vector<uint> &v, uint limit, MstrieVisitor &visitor){
+	begin_query("retrieve sup", limit);
+	if (limit > _settings->max_multiplicity) limit = _settings->max_multiplicity;
+	try {
+		check_vector(v);
+		TraceSpan span("traversal");
+		std::vector<uint> found;
+		mstrie_get_superseteq(v, limit, found, &visitor);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::pub_mstrie_get_subseteq(const std::vector<uint> &v, uint limit, uint min_cardinality, uint max_cardinality, MstrieVisitor &visitor){
+	begin_query("retrieve sub bounded", limit);
+	try {
+		check_vector(v);
+		TraceSpan span("traversal");
+		std::vector<uint> found;
+		mstrie_get_bounded(v, limit, true, min_cardinality, max_cardinality, found, &visitor);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::pub_mstrie_get_superseteq(const std::vector<uint> &v, uint limit, uint min_cardinality, uint max_cardinality, MstrieVisitor &visitor){
+	begin_query("retrieve sup bounded", limit);
+	try {
+		check_vector(v);
+		TraceSpan span("traversal");
+		std::vector<uint> found;
+		mstrie_get_bounded(v, limit, false, min_cardinality, max_cardinality, found, &visitor);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieStructure::pub_mstrie_get_nearest(const std::vector<uint> &v, uint k, const std::vector<uint> &weights, std::vector<uint> &found, std::vector<uint64_t> &distances){
+	begin_query("retrieve nearest");
+	try {
+		check_vector(v);
+		if (!weights.empty() && weights.size() != _settings->alphabet) {
+			throw MstrieException("Expected " + std::to_string(_settings->alphabet) + " weights, got " + std::to_string(weights.size()) + ".");
+		}
+		TraceSpan span("traversal");
+		mstrie_get_nearest(v, k, weights, found, distances);
+	} catch (std::exception &e) {
+		throw;
+	}
+	end_query();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::vector<uint> MstrieStructure::parse_weights(const std::string &weights) const {
+	std::vector<uint> v;
+	if (weights.empty()) return v;
+	std::stringstream tokens(weights);
+	std::string token;
+	while (std::getline(tokens, token, ',')) {
+		if (token.empty() || token.find_first_not_of("0123456789") != std::string::npos) {
+			throw MstrieException("Weight is not a non-negative number: " + token);
+		}
+		v.push_back(std::stoul(token));
+	}
+	if (v.size() != _settings->alphabet) {
+		throw MstrieException("Expected " + std::to_string(_settings->alphabet) + " weights, got " + std::to_string(v.size()) + ".");
+	}
+	return v;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint MstrieStructure::alphabet() const {
+	return _settings->alphabet;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint MstrieStructure::max_multiplicity() const {
+	return _settings->max_multiplicity;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieStructure::concurrent_queries() const {
+#ifdef MSTRIE_PROFILE
+	// the profile of the last query is recorded at every statistics level
+	return false;
+#else
+	return !MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters);
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieStructure::contains(const std::vector<uint> &v) const {
+	check_vector(v);
+	if (hash_index != nullptr) return hash_index->contains(v.data());
+	const MstrieNode *root_p = _root.get();
+	for (uint i = 0; i < _settings->alphabet && root_p != nullptr; i++) {
+		root_p = (*root_p->mult_switch)[v[i]].get();
+	}
+	return root_p != nullptr;
 }
 
 // ===============================================================================================
 // ===============================================================================================
 
 std::string MstrieStructure::print_full_stats(){
-	return statistics->generate_last_query_stats() + statistics->generate_total_stats();
+	return print_last_query_stats() + print_total_stats();
 }
 
 // -----------------------------------------------------------------------------------------------
 
 std::string MstrieStructure::print_last_query_stats(){
-	return statistics->generate_last_query_stats();
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::full)) {
+		return statistics.generate_last_query_stats();
+	}
+	if (MSTRIE_STATS_ENABLED(MstrieStatsLevel::counters)) {
+		return "Last query: nodes: " + std::to_string(statistics.last_query_traversed_nodes) + "\n";
+	}
+	return "Last query statistics are not recorded, the statistics level is none.\n";
 }
 
 // -----------------------------------------------------------------------------------------------
 
 std::string MstrieStructure::print_total_stats(){
-	return statistics->generate_total_stats();
+	return statistics.generate_total_stats() + memory_stats().generate_memory_stats();
 }
 
 // -----------------------------------------------------------------------------------------------
 
 std::string MstrieStructure::print_benchmark_stats() {
-	return statistics->generate_benchmark_stats();
+	return statistics.generate_benchmark_stats();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieStructure::print_profile_stats() {
+	return statistics.generate_profile_stats();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+MstrieMemoryStats MstrieStructure::memory_stats() const {
+	MstrieMemoryStats memory(_settings->alphabet, _settings->max_multiplicity);
+	memory_stats_rec(_root.get(), memory, 0);
+	if (hash_index != nullptr) memory.hash_index_bytes = hash_index->memory_bytes();
+	if (filter != nullptr) memory.filter_bytes = filter->memory_bytes();
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	memory.allocator_free = mallinfo2().fordblks;
+#endif
+	return memory;
+}
+void MstrieStructure::memory_stats_rec(const MstrieNode *root, MstrieMemoryStats &memory, uint vcnt) const {
+	// the blocks allocated by make_shared hold the reference counts next to the object
+	const unsigned long counts_size = sizeof(void*) + 2 * sizeof(int);
+	const unsigned long node_size = counts_size + sizeof(MstrieNode);
+	const unsigned long array_size = counts_size + sizeof(*root->mult_switch);
+	const unsigned long buffer_size = root->mult_switch->capacity() * sizeof(std::shared_ptr<MstrieNode>);
+	
+	memory.level_nodes[vcnt]++;
+	memory.level_bytes[vcnt] += node_size + array_size + buffer_size;
+	memory.node_bytes += node_size;
+	memory.child_array_bytes += array_size + buffer_size;
+	memory.allocator_overhead += MstrieMemoryStats::block_size(node_size) - node_size;
+	memory.allocator_overhead += MstrieMemoryStats::block_size(array_size) - array_size;
+	memory.allocator_overhead += MstrieMemoryStats::block_size(buffer_size) - buffer_size;
+	memory.fanout[count_children(root, 0, _settings->max_multiplicity)]++;
+	
+	for (auto &child : *root->mult_switch) {
+		if (child != nullptr && child != _dummy) {
+			memory_stats_rec(child.get(), memory, vcnt + 1);
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+const MstrieProfile& MstrieStructure::last_query_profile() const {
+	return statistics.last_query_profile;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+int MstrieStructure::last_query_traversed_nodes() const {
+	return statistics.last_query_traversed_nodes;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieStructure::update_cardinality(MstrieNode *node) const {
+	uint16_t min_cardinality = node->min_cardinality;
+	uint16_t max_cardinality = node->max_cardinality;
+	node->min_cardinality = MstrieNode::cardinality_unbounded;
+	node->max_cardinality = 0;
+	for (uint j = 0; j <= _settings->max_multiplicity; j++) {
+		const MstrieNode *child = node->mult_switch->at(j).get();
+		if (child == nullptr) continue;
+		node->include_cardinality(child->min_cardinality + j);
+		node->include_cardinality(child->max_cardinality == MstrieNode::cardinality_unbounded ? MstrieNode::cardinality_unbounded : child->max_cardinality + j);
+	}
+	return node->min_cardinality != min_cardinality || node->max_cardinality != max_cardinality;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+unsigned long MstrieStructure::count_children(const MstrieNode *node, int from, int to) const {
+	unsigned long children = 0;
+	for (int i = std::max(from, 0); i <= to && i < (int)node->mult_switch->size(); i++) {
+		if (node->mult_switch->at(i) != nullptr) children++;
+	}
+	return children;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+int MstrieStructure::number_of_nodes() const {
+	return statistics.total_number_of_nodes;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+int MstrieStructure::number_of_multisets() const {
+	return statistics.total_number_of_multisets;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+MstrieProfile::MstrieProfile(uint levels)
+: visited_nodes(levels, 0),
+limit_pruned(levels, 0),
+dead_ends(levels, 0),
+results(0) {
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieProfile::reset() {
+	std::fill(visited_nodes.begin(), visited_nodes.end(), 0);
+	std::fill(limit_pruned.begin(), limit_pruned.end(), 0);
+	std::fill(dead_ends.begin(), dead_ends.end(), 0);
+	results = 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieProfile::merge(const MstrieProfile &profile) {
+	if (visited_nodes.size() < profile.visited_nodes.size()) {
+		visited_nodes.resize(profile.visited_nodes.size(), 0);
+		limit_pruned.resize(profile.visited_nodes.size(), 0);
+		dead_ends.resize(profile.visited_nodes.size(), 0);
+	}
+	for (size_t level = 0; level < profile.visited_nodes.size(); level++) {
+		visited_nodes[level] += profile.visited_nodes[level];
+		limit_pruned[level] += profile.limit_pruned[level];
+		dead_ends[level] += profile.dead_ends[level];
+	}
+	results += profile.results;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+MstrieMemoryStats::MstrieMemoryStats(uint levels, uint max_multiplicity)
+: level_nodes(levels, 0),
+level_bytes(levels, 0),
+fanout(max_multiplicity + 2, 0),
+node_bytes(0),
+child_array_bytes(0),
+allocator_overhead(0),
+allocator_free(-1),
+hash_index_bytes(0),
+filter_bytes(0) {
+}
+
+// -----------------------------------------------------------------------------------------------
+
+unsigned long MstrieMemoryStats::total_bytes() const {
+	return node_bytes + child_array_bytes + allocator_overhead + hash_index_bytes + filter_bytes;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+unsigned long MstrieMemoryStats::block_size(unsigned long size) {
+	return std::max(32ul, (size + 8 + 15) & ~15ul);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieMemoryStats::generate_memory_stats() const {
+	std::string stats;
+	stats += "Memory: " + std::to_string(total_bytes()) + " bytes";
+	stats += "; nodes: " + std::to_string(node_bytes);
+	stats += "; child arrays: " + std::to_string(child_array_bytes);
+	stats += "; allocator overhead: " + std::to_string(allocator_overhead);
+	if (hash_index_bytes > 0) {
+		stats += "; hash index: " + std::to_string(hash_index_bytes);
+	}
+	if (filter_bytes > 0) {
+		stats += "; membership filter: " + std::to_string(filter_bytes);
+	}
+	if (allocator_free >= 0) {
+		stats += "; allocator free: " + std::to_string(allocator_free);
+	}
+	stats += "\nlevel;nodes;bytes\n";
+	for (size_t level = 0; level < level_nodes.size(); level++) {
+		stats += std::to_string(level) + ";" + std::to_string(level_nodes[level]) + ";" + std::to_string(level_bytes[level]) + "\n";
+	}
+	stats += "children;nodes\n";
+	for (size_t children = 0; children < fanout.size(); children++) {
+		stats += std::to_string(children) + ";" + std::to_string(fanout[children]) + "\n";
+	}
+	return stats;
 }
 
 // -----------------------------------------------------------------------------------------------
@@ -574,6 +1955,7 @@ void MstrieStats::reset(){
 	last_query_time_taken = 0;
 	last_query_traversed_nodes = 0;
 	last_query_name = "";
+	MSTRIE_PROFILE_RECORD(last_query_profile.reset());
 }
 
 // -----------------------------------------------------------------------------------------------
@@ -581,7 +1963,7 @@ void MstrieStats::reset(){
 std::string MstrieStats::generate_last_query_stats(){
 	std::string stats;
 	stats += "Last query: " + last_query_name;
-	stats += "; time: " + std::to_string(last_query_time_taken) + " ms";
+	stats += "; time: " + std::to_string(last_query_time_taken) + " " + time_units;
 	stats += "; nodes: " + std::to_string(last_query_traversed_nodes);
 	stats += "\n";
 	return stats;
@@ -593,13 +1975,33 @@ std::string MstrieStats::generate_total_stats(){
 	std::string stats;
 	stats += "Total nodes: " + std::to_string(total_number_of_nodes);
 	stats += "; total multisets: " + std::to_string(total_number_of_multisets);
-	//stats += "; space taken: " + std::to_string(sizeof(Mstrie)*total_number_of_nodes);
 	stats += "\n";
 	return stats;
 }
 
 // -----------------------------------------------------------------------------------------------
 
+std::string MstrieStats::generate_profile_stats(){
+#ifdef MSTRIE_PROFILE
+	std::string stats;
+	stats += "Last query profile: " + last_query_name;
+	stats += "; results: " + std::to_string(last_query_profile.results);
+	stats += "\nlevel;visited;limit_pruned;dead_ends\n";
+	for (size_t level = 0; level < last_query_profile.visited_nodes.size(); level++) {
+		stats += std::to_string(level);
+		stats += ";" + std::to_string(last_query_profile.visited_nodes[level]);
+		stats += ";" + std::to_string(last_query_profile.limit_pruned[level]);
+		stats += ";" + std::to_string(last_query_profile.dead_ends[level]);
+		stats += "\n";
+	}
+	return stats;
+#else
+	return "Query profiles are not recorded, the program is built without --enable-profile.\n";
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------
+
 std::string MstrieStats::generate_benchmark_stats(){
 	std::string stats;
 	stats += std::to_string(last_query_time_taken);
@@ -612,38 +2014,17 @@ std::string MstrieStats::generate_benchmark_stats(){
 // -----------------------------------------------------------------------------------------------
 
 void MstrieStats::set_start_time() {
-	this->tp_start = std::chrono::system_clock::now();
+	this->tp_start = std::chrono::steady_clock::now();
 }
 
 // -----------------------------------------------------------------------------------------------
 
 void MstrieStats::set_end_time() {
-	this->tp_end = std::chrono::system_clock::now();
-}
-
-// -----------------------------------------------------------------------------------------------
-
-template<typename T>
-void MstrieStats::calculate_last_query_time() {
-	this->last_query_time_taken = std::chrono::duration_cast<T>(tp_end - tp_start).count();
+	this->tp_end = std::chrono::steady_clock::now();
 }
 
 // -----------------------------------------------------------------------------------------------
 
 void MstrieStats::set_last_query_time() {
-	if (time_units.compare("s") == 0) {
-		this->calculate_last_query_time<std::chrono::seconds>();
-	}
-	else if (time_units.compare("ms") == 0) {
-		this->calculate_last_query_time<std::chrono::milliseconds>();
-	}
-	else if (time_units.compare("µs") == 0) {
-		this->calculate_last_query_time<std::chrono::microseconds>();
-	}
-	else if (time_units.compare("ns") == 0) {
-		this->calculate_last_query_time<std::chrono::nanoseconds>();
-	}
-	else {
-		throw std::runtime_error("Unknown time units.");
-	}
+	this->last_query_time_taken = std::chrono::duration_cast<std::chrono::nanoseconds>(tp_end - tp_start).count() / time_unit_ns;
 }
@@ -9,31 +9,109 @@
 #ifndef MSTRIE_HPP
 #define MSTRIE_HPP
 
+#include <cstdint>
 #include <queue>
+#include <string>
+#include <vector>
 #include <chrono>
 #include <memory>
+#include <atomic>
+#include "hash_index.hpp"
+#include "membership_filter.hpp"
 
 
+/* Per-level statistics of a query
+ *
+ * Level 0 is the root and the last level is the acceptor. The queries
+ * record the profile only if the program is built with MSTRIE_PROFILE
+ * (configure --enable-profile), otherwise the recording is compiled out.
+ */
+class MstrieProfile {
+public:
+	// nodes entered at the level
+	std::vector<unsigned long> visited_nodes;
+	// existing children not entered because their multiplicity is out of the limit
+	std::vector<unsigned long> limit_pruned;
+	// visited nodes whose subtree did not give any result
+	std::vector<unsigned long> dead_ends;
+	// multisets found
+	unsigned long results;
+	
+	MstrieProfile(uint levels = 0);
+	
+	void reset();
+	// adds the counts of profile, the levels are extended if needed
+	void merge(const MstrieProfile &profile);
+};
+
+/* Memory taken by the nodes reachable from the root
+ *
+ * Every node is made of three heap blocks: the node with its reference
+ * counts, the child array object with its reference counts and the
+ * buffer of child pointers. The allocator overhead is computed for
+ * blocks of a glibc-like allocator, 16-byte aligned with an 8-byte header.
+ */
+class MstrieMemoryStats {
+public:
+	// node count per level, the acceptor is not counted
+	std::vector<unsigned long> level_nodes;
+	// requested bytes per level
+	std::vector<unsigned long> level_bytes;
+	// node count by the number of existing children
+	std::vector<unsigned long> fanout;
+	// requested bytes of nodes and their reference counts
+	unsigned long node_bytes;
+	// requested bytes of child arrays, their reference counts and buffers
+	unsigned long child_array_bytes;
+	// bytes of heap blocks above the requested bytes
+	unsigned long allocator_overhead;
+	// free bytes kept by the allocator of the whole process, -1 - unknown
+	long allocator_free;
+	// bytes of the hash index of the multisets, 0 - no index
+	unsigned long hash_index_bytes;
+	// bytes of the membership filter of the multisets, 0 - no filter
+	unsigned long filter_bytes;
+	
+	MstrieMemoryStats(uint levels, uint max_multiplicity);
+	
+	unsigned long total_bytes() const;
+	// heap block taken by a request of size bytes
+	static unsigned long block_size(unsigned long size);
+	// creates statistics output with breakdown per level and fan-out histogram
+	std::string generate_memory_stats() const;
+};
+
+/* Statistics recorded by every query
+ *
+ * none - only the total numbers of nodes and multisets are kept;
+ * counters - the number of nodes traversed by the last query as well;
+ * full - the name and the time of the last query as well.
+ * The highest level is fixed when the program is configured
+ * (--enable-statistics), an mstrie can be set to a lower one.
+ */
+enum class MstrieStatsLevel { none = 0, counters = 1, full = 2 };
+
 /* The class that holds statistics of the mstrie structure */
 class MstrieStats {
 private:
-	template<typename T>
-	void calculate_last_query_time();
+	// nanoseconds in time_units
+	long time_unit_ns;
 public:
 	int total_number_of_nodes;
 	int total_number_of_multisets;
 	int last_query_traversed_nodes;
 	long last_query_time_taken;
 	std::string last_query_name;
+	MstrieProfile last_query_profile;
 	
-	std::chrono::system_clock::time_point tp_start;
-	std::chrono::system_clock::time_point tp_end;
+	std::chrono::steady_clock::time_point tp_start;
+	std::chrono::steady_clock::time_point tp_end;
 	
 	void set_start_time();
 	void set_end_time();
 	
 	void set_last_query_time();
-	std::string time_units;
+	const std::string time_units;
 	
 	
 	MstrieStats(const std::string &units = "µs"); // micro sec by default
@@ -46,6 +124,8 @@ public:
 	std::string generate_total_stats();
 	// creates statistics output for benchmark
 	std::string generate_benchmark_stats();
+	// creates per-level statistics output for last query
+	std::string generate_profile_stats();
 };
 
 /* The mstrie settings */
@@ -58,7 +138,21 @@ public:
 	
 	const std::string index_path;
 	
-	MstrieSettings(uint alphabet, uint max_multiplicity, const std::string &index_path);
+	// multisets are written as "element:multiplicity" instead of repeating the element
+	const bool run_length_notation;
+	// the mstrie is saved in the compressed binary format
+	const bool compressed_format;
+	// lowered to the level the program is configured with
+	const MstrieStatsLevel statistics;
+	// exact searches are answered by a hash table of the multisets
+	const bool hash_index;
+	// exact searches of missing multisets are rejected by a membership filter
+	// with at most this false-positive rate, 0 - no filter
+	const double filter_false_positive_rate;
+	
+	MstrieSettings(uint alphabet, uint max_multiplicity, const std::string &index_path, bool run_length_notation = false, bool compressed_format = false, MstrieStatsLevel statistics = MstrieStatsLevel::full, bool hash_index = false, double filter_false_positive_rate = 0);
+	
+	static MstrieStatsLevel parse_statistics_level(const std::string &level);
 };
 
 /* The base class for nodes in the mstrie structure */
@@ -68,8 +162,50 @@ public:
 	// array with pointers that represent the multiplicity
 	// and gives access to corresponding child node
 	std::shared_ptr<std::vector<std::shared_ptr<MstrieNode>>> mult_switch;
+	// the version of the mstrie structure the node was created in
+	uint epoch;
+	// bounds of the cardinality of the multisets below the node, counting the elements
+	// from its level on; they take the padding after epoch, so they are 16 bits wide
+	// and a maximum of cardinality_unbounded is not known
+	uint16_t min_cardinality;
+	uint16_t max_cardinality;
+	
+	static const uint16_t cardinality_unbounded = 0xFFFF;
 	
-	MstrieNode(const uint max_multiplicity);
+	MstrieNode(const uint max_multiplicity, const uint epoch = 0);
+	// copies the node with the pointers to its children
+	MstrieNode(const MstrieNode &node, const uint epoch);
+	// widens the bounds to a multiset of cardinality below the node
+	void include_cardinality(uint cardinality);
+};
+
+/* Frozen version of the mstrie structure
+ *
+ * The nodes reachable from the snapshot root are never changed while
+ * the snapshot is held, so the snapshot can be read from another thread.
+ */
+class MstrieSnapshot {
+public:
+	const std::shared_ptr<MstrieNode> root;
+	const int total_number_of_multisets;
+	
+	MstrieSnapshot(const std::shared_ptr<MstrieNode> &root, int total_number_of_multisets);
+};
+
+/* Best multisets of a nearest neighbour search, the worst one on top
+ *
+ * Ordered by the distance and then by the multiplicities, so the ties
+ * are broken towards the first multisets of the mstrie.
+ */
+typedef std::priority_queue<std::pair<uint64_t, std::vector<uint>>> MstrieNearest;
+
+/* Receives the multisets found by a retrieval during the traversal */
+class MstrieVisitor {
+public:
+	virtual ~MstrieVisitor() { }
+	// the multiplicity vector of a found multiset, valid only during the call;
+	// the traversal stops once false is returned
+	virtual bool visit(const uint *multiplicities) = 0;
 };
 
 /* The class for mstrie structure management */
@@ -80,13 +216,33 @@ private:
 	// indicator node: multiset acceptor
 	const std::shared_ptr<MstrieNode> _dummy;
 	// root node of the mstrie structure
-	const std::shared_ptr<MstrieNode> _root;
+	std::shared_ptr<MstrieNode> _root;
+	
+	MstrieStats statistics;
+	// kept in sync with the multisets of the structure, if configured
+	std::unique_ptr<MstrieHashIndex> hash_index;
+	std::unique_ptr<MstrieCuckooFilter> filter;
+	// the filter was read with the index file and already holds its multisets
+	bool filter_restored;
+	
+	// current version of the mstrie structure
+	uint epoch;
+	// nodes of older versions are shared with a snapshot
+	bool frozen;
 	
-	std::unique_ptr<MstrieStats> statistics;
+	// start and end of every public query, record the statistics of the configured level
+	void begin_query(const char *name, int limit = -1);
+	void end_query();
+	
+	// returns node in slot that may be changed, copying it if it is shared with a snapshot
+	const std::shared_ptr<MstrieNode>& writable(std::shared_ptr<MstrieNode> &slot);
 	
 	/* private queries */
 	// insert
-	void mstrie_insert(const std::vector<uint> &sv_input);
+	void mstrie_insert(const uint *sv_input);
+	// insert below path[level], path holds the nodes of the previously inserted multiset,
+	// only for loading into the structure without snapshots
+	void mstrie_insert_from(const uint *sv_input, uint level, std::vector<MstrieNode*> &path);
 	// delete
 	void mstrie_delete(const std::vector<uint> &sv_input);
 	// search
@@ -98,18 +254,59 @@ private:
 	bool mstrie_superseteq(const std::vector<uint> &sv_input, uint limit);
 	bool mstrie_superseteq_rec(const std::shared_ptr<MstrieNode> root, const std::vector<uint> &sv_input, uint limit, uint vcnt);
 	// retrieval closest sub
-	std::queue<std::string> mstrie_get_subseteq(const std::vector<uint> &sv_input, uint limit);
-	void mstrie_get_subseteq_rec(const std::shared_ptr<MstrieNode> root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, std::queue<std::string> &str_que, uint limit, uint vcnt);
+	// the multiplicity vectors of found multisets follow each other in found, or are handed
+	// to visitor if it is given; the rec functions take either as Sink, so collecting the
+	// vectors costs nothing for the visitor, and return false once the visitor stops them
+	void mstrie_get_subseteq(const std::vector<uint> &sv_input, uint limit, std::vector<uint> &found, MstrieVisitor *visitor = nullptr);
+	template <typename Sink>
+	bool mstrie_get_subseteq_rec(const std::shared_ptr<MstrieNode> root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, Sink &found, uint limit, uint vcnt);
 	// retrieval closest super
-	std::queue<std::string> mstrie_get_superseteq(const std::vector<uint> &sv_input, uint limit);
-	void mstrie_get_superseteq_rec(const std::shared_ptr<MstrieNode> root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, std::queue<std::string> &str_que, uint limit, uint vcnt);
+	void mstrie_get_superseteq(const std::vector<uint> &sv_input, uint limit, std::vector<uint> &found, MstrieVisitor *visitor = nullptr);
+	template <typename Sink>
+	bool mstrie_get_superseteq_rec(const std::shared_ptr<MstrieNode> root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, Sink &found, uint limit, uint vcnt);
+	// retrieval closest sub or super with a cardinality in [min_cardinality, max_cardinality],
+	// query_rest holds the cardinality of the query from every level on
+	void mstrie_get_bounded(const std::vector<uint> &sv_input, uint limit, bool sub, uint min_cardinality, uint max_cardinality, std::vector<uint> &found, MstrieVisitor *visitor = nullptr);
+	template <typename Sink>
+	bool mstrie_get_bounded_rec(const MstrieNode *root, const std::vector<uint> &sv_input, const std::vector<uint> &query_rest, std::vector<uint> &sv_output, Sink &found, uint limit, bool sub, uint min_cardinality, uint max_cardinality, uint cardinality, uint vcnt);
+	// retrieval of the maximal sub or the minimal super multisets, the traversal visits every
+	// multiset after the multisets that cover it; dominating holds the found multisets that
+	// cover the path so far, equal_from the level from which every found multiset equals the query
+	void mstrie_get_extremal(const std::vector<uint> &sv_input, uint limit, bool sub, std::vector<uint> &found);
+	void mstrie_get_extremal_rec(const MstrieNode *root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, std::vector<uint> &found, std::vector<uint> &equal_from, const std::vector<size_t> &dominating, uint limit, bool sub, uint vcnt);
+	// retrieval within a total distance, the multiplicities may be below the query if below
+	// and above it if above, every difference is taken from the budget
+	void mstrie_get_within(const std::vector<uint> &sv_input, uint budget, bool below, bool above, std::vector<uint> &found);
+	void mstrie_get_within_rec(const MstrieNode *root, const std::vector<uint> &sv_input, std::vector<uint> &sv_output, std::vector<uint> &found, uint budget, bool below, bool above, uint vcnt);
+	// retrieval of the k nearest multisets by weighted L1 distance, nearest first
+	void mstrie_get_nearest(const std::vector<uint> &sv_input, uint k, const std::vector<uint> &weights, std::vector<uint> &found, std::vector<uint64_t> &distances);
+	void mstrie_get_nearest_rec(const MstrieNode *root, const std::vector<uint> &sv_input, const std::vector<uint> &weights, std::vector<uint> &sv_output, MstrieNearest &nearest, uint k, uint64_t distance, uint vcnt);
 	
 	/* utility functions */
-	std::string prepare_mstrie_dump(std::queue<std::string> queue);
-	std::string timestamp_string();
+	std::string prepare_mstrie_dump(const MstrieNode *root, unsigned long long checkpoint_lsn, std::atomic<unsigned long> *progress) const;
+	void prepare_mstrie_dump_rec(const MstrieNode *root, std::vector<uint> &sv_output, std::string &content, std::atomic<unsigned long> *progress, uint vcnt) const;
+	void prepare_compressed_dump_rec(const MstrieNode *root, std::vector<uint> &sv_output, std::string &content, std::atomic<unsigned long> *progress, uint vcnt, uint &shared_prefix) const;
+	unsigned long long load_plain_mstrie(const char *content, size_t size, uint threads);
+	unsigned long long load_compressed_mstrie(const char *content, size_t size);
+	// adds a multiset to the filter, the filter is rebuilt larger when it is full
+	void filter_insert(const uint *sv_input);
+	void rebuild_filter(size_t buckets);
+	// false if the filter got full
+	bool rebuild_filter_rec(const MstrieNode *root, std::vector<uint> &sv_output, uint vcnt);
+	std::string timestamp_string() const;
 	
-	std::vector<uint> str_to_num(const std::string &token);
-	std::string num_to_str(const std::vector<uint> &v);
+	void append_num_str(const uint *v, size_t size, std::string &s) const;
+	// words of the found multisets separated by '|'
+	std::string join_found(const std::vector<uint> &found) const;
+	// number of existing children with multiplicity in [from, to]
+	unsigned long count_children(const MstrieNode *node, int from, int to) const;
+	void memory_stats_rec(const MstrieNode *root, MstrieMemoryStats &memory, uint vcnt) const;
+	// sets the cardinality bounds of the node from its children, false if they are unchanged
+	bool update_cardinality(MstrieNode *node) const;
+	// throws if v is not a multiplicity vector of the mstrie
+	void check_vector(const std::vector<uint> &v) const;
+	// comma-separated weight of every element, empty - no weights
+	std::vector<uint> parse_weights(const std::string &weights) const;
 public:
 	MstrieStructure(const MstrieSettings &settings);
 	
@@ -127,9 +324,34 @@ public:
 	};
 	
 	
+	/* conversion functions */
+	// multiset word into multiplicity vector of alphabet size
+	std::vector<uint> str_to_num(const std::string &token);
+	// multiplicity vector into multiset word
+	std::string num_to_str(const std::vector<uint> &v) const;
+	
 	/* read/write functions */
-	void load_mstrie(const std::string &content);
-	std::string retrieve_mstrie();
+	// returns the write-ahead log sequence number the content is consistent with
+	unsigned long long load_mstrie(const std::string &content);
+	// the multisets are parsed on threads, 0 - one thread per hardware thread,
+	// the compressed format is detected and is always read on one thread
+	unsigned long long load_mstrie(const char *content, size_t size, uint threads = 1);
+	std::string retrieve_mstrie(unsigned long long checkpoint_lsn = 0);
+	
+	/* snapshots */
+	// freezes the current version, the following updates copy the nodes they change
+	std::shared_ptr<MstrieSnapshot> freeze();
+	// ends copying of nodes, to be called when no snapshot is held anymore
+	void release_snapshots();
+	// safe to call from another thread while the mstrie is queried and updated
+	std::string retrieve_snapshot(const MstrieSnapshot &snapshot, unsigned long long checkpoint_lsn, std::atomic<unsigned long> *progress) const;
+	
+	/* membership filter */
+	// copy of the filter to be saved with the index, nullptr if none is configured
+	std::shared_ptr<MstrieCuckooFilter> copy_filter() const;
+	// takes a filter saved with the index file, to be called before the index is loaded;
+	// the filter is rebuilt if it does not hold the loaded multisets
+	void restore_filter(std::unique_ptr<MstrieCuckooFilter> restored);
 	
 	/* public queries */
 	
@@ -151,10 +373,62 @@ public:
 	// retrieval closest super
 	std::string pub_mstrie_get_superseteq(const std::string &word);
 	std::string pub_mstrie_get_superseteq(const std::string &word, uint limit);
+	// retrieval closest sub and super of a cardinality in [min_cardinality, max_cardinality]
+	std::string pub_mstrie_get_subseteq(const std::string &word, uint limit, uint min_cardinality, uint max_cardinality);
+	std::string pub_mstrie_get_superseteq(const std::string &word, uint limit, uint min_cardinality, uint max_cardinality);
+	// retrieval of the closest sub that are not a submultiset of another closest sub
+	std::string pub_mstrie_get_maximal_subseteq(const std::string &word, uint limit);
+	// retrieval of the closest super that are not a supermultiset of another closest super
+	std::string pub_mstrie_get_minimal_superseteq(const std::string &word, uint limit);
+	// retrieval within an L1 distance of at most distance
+	std::string pub_mstrie_get_within(const std::string &word, uint distance);
+	// retrieval of the submultisets with at most distance elements less
+	std::string pub_mstrie_get_subseteq_within(const std::string &word, uint distance);
+	// retrieval of the supermultisets with at most distance elements more
+	std::string pub_mstrie_get_superseteq_within(const std::string &word, uint distance);
+	// retrieval of the k nearest multisets by L1 distance, weighted per element if weights
+	// holds a comma-separated weight of every element, as "word (distance)" separated by '|'
+	std::string pub_mstrie_get_nearest(const std::string &word, uint k, const std::string &weights = "");
+	
+	/* public queries on multiplicity vectors */
+	// a vector has alphabet multiplicities of at most max_multiplicity
+	void pub_mstrie_insert(const std::vector<uint> &v);
+	void pub_mstrie_delete(const std::vector<uint> &v);
+	bool pub_mstrie_search(const std::vector<uint> &v);
+	bool pub_mstrie_subseteq(const std::vector<uint> &v, uint limit);
+	bool pub_mstrie_superseteq(const std::vector<uint> &v, uint limit);
+	// appends the multiplicity vectors of the found multisets to found, one after another
+	void pub_mstrie_get_subseteq(const std::vector<uint> &v, uint limit, std::vector<uint> &found);
+	void pub_mstrie_get_superseteq(const std::vector<uint> &v, uint limit, std::vector<uint> &found);
+	void pub_mstrie_get_subseteq(const std::vector<uint> &v, uint limit, uint min_cardinality, uint max_cardinality, std::vector<uint> &found);
+	void pub_mstrie_get_superseteq(const std::vector<uint> &v, uint limit, uint min_cardinality, uint max_cardinality, std::vector<uint> &found);
+	// hand the found multisets to visitor during the traversal, in the same order, until it stops them
+	void pub_mstrie_get_subseteq(const std::vector<uint> &v, uint limit, MstrieVisitor &visitor);
+	void pub_mstrie_get_superseteq(const std::vector<uint> &v, uint limit, MstrieVisitor &visitor);
+	void pub_mstrie_get_subseteq(const std::vector<uint> &v, uint limit, uint min_cardinality, uint max_cardinality, MstrieVisitor &visitor);
+	void pub_mstrie_get_superseteq(const std::vector<uint> &v, uint limit, uint min_cardinality, uint max_cardinality, MstrieVisitor &visitor);
+	// weights holds a weight per element or is empty for the plain L1 distance,
+	// distances gets the distance of every found multiset
+	void pub_mstrie_get_nearest(const std::vector<uint> &v, uint k, const std::vector<uint> &weights, std::vector<uint> &found, std::vector<uint64_t> &distances);
+	
+	uint alphabet() const;
+	uint max_multiplicity() const;
+	// the queries record nothing in the structure, so they can run on several threads
+	// at once as long as no update runs with them
+	bool concurrent_queries() const;
+	// whether v is stored, without recording a query; throws if v is not a multiplicity vector
+	bool contains(const std::vector<uint> &v) const;
 	
 	std::string print_full_stats();
 	std::string print_last_query_stats();
 	std::string print_total_stats();
 	std::string print_benchmark_stats();
+	std::string print_profile_stats();
+	// walks the whole mstrie
+	MstrieMemoryStats memory_stats() const;
+	const MstrieProfile& last_query_profile() const;
+	int last_query_traversed_nodes() const;
+	int number_of_nodes() const;
+	int number_of_multisets() const;
 };
 #endif /* MSTRIE_HPP */
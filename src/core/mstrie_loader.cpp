@@ -0,0 +1,192 @@
+//
+//  mstrie_loader.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <string>
+#include <thread>
+#include "mstrie_loader.hpp"
+#include "mstrie.hpp"
+
+
+MstrieBatch::MstrieBatch(uint alphabet)
+: alphabet(alphabet) {};
+
+// -----------------------------------------------------------------------------------------------
+
+size_t MstrieBatch::size() const {
+	return multiplicities.size() / alphabet;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+const uint* MstrieBatch::at(size_t i) const {
+	return multiplicities.data() + i * alphabet;
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+MstrieLoader::MstrieLoader(uint alphabet, uint max_multiplicity, uint threads, size_t chunk_size)
+: _alphabet(alphabet),
+_max_multiplicity(max_multiplicity),
+_threads(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())),
+_chunk_size(chunk_size) {};
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieLoader::parse_multiset(const char *begin, const char *end, uint alphabet, uint max_multiplicity, uint *sv_output) {
+	std::fill(sv_output, sv_output + alphabet, 0);
+	while (end > begin && (end[-1] == '\r' || end[-1] == ' ')) --end;
+	if (begin == end || (end - begin == 1 && *begin == '*')) {
+		return;
+	}
+	const char *p = begin;
+	while (p < end) {
+		if (*p == '-') {
+			throw MstrieStructure::MstrieException("Token cannot have negative values.");
+		}
+		const char *digits = p;
+		uint value = 0;
+		while (p < end && *p >= '0' && *p <= '9') {
+			// values beyond the alphabet are rejected below, no need to keep counting
+			value = std::min(value * 10 + (*p - '0'), alphabet);
+			++p;
+		}
+		if (p == digits) {
+			throw MstrieStructure::MstrieException("Token is not a multiset: " + std::string(begin, end));
+		}
+		if (value > alphabet - 1) {
+			throw MstrieStructure::MstrieException("Token cannot have values greater than alphabet size.");
+		}
+		uint count = 1;
+		if (p < end && *p == ':') {
+			// run-length notation element:multiplicity
+			digits = ++p;
+			count = 0;
+			while (p < end && *p >= '0' && *p <= '9') {
+				// too large multiplicities are rejected below, no need to keep counting
+				count = std::min(count * 10 + (*p - '0'), 1u << 24);
+				++p;
+			}
+			if (p == digits) {
+				throw MstrieStructure::MstrieException("Token is not a multiset: " + std::string(begin, end));
+			}
+		}
+		// the total of a repeated element is checked, so it cannot wrap around
+		if (count > max_multiplicity - sv_output[value]) {
+			throw MstrieStructure::MstrieException("Multiplicity cannot be greater than " + std::to_string(max_multiplicity) + ".");
+		}
+		sv_output[value] += count;
+		if (p == end) break;
+		if (*p != ',') {
+			throw MstrieStructure::MstrieException("Token is not a multiset: " + std::string(begin, end));
+		}
+		++p;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+MstrieBatch MstrieLoader::parse_chunk(const char *begin, const char *end) const {
+	MstrieBatch batch(_alphabet);
+	const char *line = begin;
+	while (line < end) {
+		const char *line_end = static_cast<const char*>(memchr(line, '\n', end - line));
+		if (line_end == nullptr) line_end = end;
+		size_t offset = batch.multiplicities.size();
+		batch.multiplicities.resize(offset + _alphabet);
+		parse_multiset(line, line_end, _alphabet, _max_multiplicity, batch.multiplicities.data() + offset);
+		line = line_end + 1;
+	}
+	return batch;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieLoader::parse(const char *data, size_t size, const std::function<void(const MstrieBatch&)> &consumer) const {
+	const char *data_end = data + size;
+	const char *chunk_begin = data;
+
+	// cuts the next chunk at the line break after chunk size
+	auto next_chunk = [&]() {
+		const char *chunk_end = chunk_begin + std::min(_chunk_size, static_cast<size_t>(data_end - chunk_begin));
+		if (chunk_end < data_end) {
+			const char *line_end = static_cast<const char*>(memchr(chunk_end, '\n', data_end - chunk_end));
+			chunk_end = (line_end == nullptr) ? data_end : line_end + 1;
+		}
+		std::pair<const char*, const char*> chunk(chunk_begin, chunk_end);
+		chunk_begin = chunk_end;
+		return chunk;
+	};
+
+	if (_threads == 1) {
+		while (chunk_begin < data_end) {
+			auto chunk = next_chunk();
+			consumer(parse_chunk(chunk.first, chunk.second));
+		}
+		return;
+	}
+
+	// chunks are parsed ahead while the batches are consumed
+	std::deque<std::future<MstrieBatch>> in_flight;
+	auto launch = [&]() {
+		auto chunk = next_chunk();
+		in_flight.push_back(std::async(std::launch::async, &MstrieLoader::parse_chunk, this, chunk.first, chunk.second));
+	};
+	while (chunk_begin < data_end && in_flight.size() < _threads) {
+		launch();
+	}
+	while (!in_flight.empty()) {
+		MstrieBatch batch = in_flight.front().get();
+		in_flight.pop_front();
+		if (chunk_begin < data_end) {
+			launch();
+		}
+		consumer(batch);
+	}
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+const std::string MstrieCompressedFormat::magic = "MSTRIEZ\n";
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieCompressedFormat::detect(const char *data, size_t size) {
+	return size >= magic.size() && magic.compare(0, magic.size(), data, magic.size()) == 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieCompressedFormat::append_varint(std::string &s, unsigned long long value) {
+	while (value >= 0x80) {
+		s += static_cast<char>((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	s += static_cast<char>(value);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+unsigned long long MstrieCompressedFormat::read_varint(const char *&p, const char *end) {
+	unsigned long long value = 0;
+	for (uint shift = 0; shift < 64; shift += 7) {
+		if (p == end) {
+			throw MstrieStructure::MstrieException("Unexpected end of compressed mstrie.");
+		}
+		unsigned char byte = static_cast<unsigned char>(*p++);
+		value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			return value;
+		}
+	}
+	throw MstrieStructure::MstrieException("Corrupted varint in compressed mstrie.");
+}
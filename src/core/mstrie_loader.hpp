@@ -0,0 +1,73 @@
+//
+//  mstrie_loader.hpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#ifndef MSTRIE_LOADER_HPP
+#define MSTRIE_LOADER_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+
+
+/* Multisets parsed from a part of the input */
+class MstrieBatch {
+public:
+	const uint alphabet;
+	// multiplicity vectors of the multisets, one after another
+	std::vector<uint> multiplicities;
+
+	MstrieBatch(uint alphabet);
+
+	size_t size() const;
+	const uint* at(size_t i) const;
+};
+
+/* Parser of multisets in text format, one multiset per line
+ *
+ * The input is split into line-aligned chunks that are parsed on
+ * several threads, while the batches are consumed in input order.
+ */
+class MstrieLoader {
+private:
+	const uint _alphabet;
+	const uint _max_multiplicity;
+	const uint _threads;
+	const size_t _chunk_size;
+
+	MstrieBatch parse_chunk(const char *begin, const char *end) const;
+public:
+	// threads = 0 - one thread per hardware thread
+	MstrieLoader(uint alphabet, uint max_multiplicity, uint threads = 0, size_t chunk_size = 1 << 22);
+
+	void parse(const char *data, size_t size, const std::function<void(const MstrieBatch&)> &consumer) const;
+
+	// parses multiset "e1,e2,..." or "*" (empty multiset) into multiplicity vector of alphabet size,
+	// an element can be followed by its multiplicity "e1:m1,e2,...", the multiplicity of an element
+	// cannot exceed max_multiplicity
+	static void parse_multiset(const char *begin, const char *end, uint alphabet, uint max_multiplicity, uint *sv_output);
+};
+
+/* Compressed format of mstrie files
+ *
+ * The header is the magic followed by the varints of the timestamp, the
+ * checkpoint lsn, the maximal multiplicity and the alphabet size. Every
+ * multiset is written in trie order as the varint length of the prefix
+ * it shares with the previous multiset, followed by the varints of its
+ * remaining multiplicities.
+ */
+class MstrieCompressedFormat {
+public:
+	static const std::string magic;
+
+	// checks if data starts with the magic
+	static bool detect(const char *data, size_t size);
+	// LEB128 encoding: 7 bits per byte, the high bit is set if more bytes follow
+	static void append_varint(std::string &s, unsigned long long value);
+	static unsigned long long read_varint(const char *&p, const char *end);
+};
+
+#endif /* MSTRIE_LOADER_HPP */
@@ -0,0 +1,192 @@
+//
+//  query_cache.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <numeric>
+
+#include "query_cache.hpp"
+
+
+MstrieQueryCache::MstrieQueryCache(size_t budget)
+: budget(budget) {
+	used = 0;
+	hits = 0;
+	misses = 0;
+	evictions = 0;
+	invalidations = 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieQueryCache::make_key(MstrieCacheEntry::Kind kind, const std::vector<uint> &multiset, uint limit) {
+	std::string key;
+	key.reserve(1 + (multiset.size() + 1) * sizeof(uint));
+	key += static_cast<char>(kind);
+	key.append(reinterpret_cast<const char*>(&limit), sizeof(uint));
+	key.append(reinterpret_cast<const char*>(multiset.data()), multiset.size() * sizeof(uint));
+	return key;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieQueryCache::lookup(const std::string &key, bool &found, std::string &result) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto entry = index.find(key);
+	if (entry == index.end()) {
+		misses++;
+		return false;
+	}
+	hits++;
+	entries.splice(entries.begin(), entries, entry->second);
+	found = entry->second->found;
+	result = entry->second->result;
+	return true;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieQueryCache::store(const std::string &key, MstrieCacheEntry::Kind kind, const std::vector<uint> &multiset, uint limit, bool found, const std::string &result) {
+	// the key is held by the entry and by the index, the nodes of the index and the candidate are counted roughly
+	size_t bytes = sizeof(MstrieCacheEntry) + sizeof(MstrieCacheCandidate) + 2 * key.size() + multiset.size() * sizeof(uint) + result.size() + 64;
+	std::lock_guard<std::mutex> lock(mutex);
+	auto existing = index.find(key);
+	if (existing != index.end()) erase(existing->second);
+	if (bytes > budget) return;
+	while (used + bytes > budget) {
+		erase(std::prev(entries.end()));
+		evictions++;
+	}
+	entries.push_front(MstrieCacheEntry{ key, kind, multiset, limit, found, result, bytes, 0 });
+	index.emplace(key, entries.begin());
+	auto kind_candidates = candidates(kind);
+	if (kind_candidates != nullptr) {
+		entries.begin()->candidate = kind_candidates->size();
+		uint cardinality = std::accumulate(multiset.begin(), multiset.end(), 0u);
+		kind_candidates->push_back(MstrieCacheCandidate{ support(multiset), cardinality, entries.begin() });
+	}
+	used += bytes;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieQueryCache::erase(std::list<MstrieCacheEntry>::iterator entry) {
+	used -= entry->bytes;
+	auto kind_candidates = candidates(entry->kind);
+	if (kind_candidates != nullptr) {
+		// the last candidate takes the place of the entry
+		(*kind_candidates)[entry->candidate] = kind_candidates->back();
+		(*kind_candidates)[entry->candidate].entry->candidate = entry->candidate;
+		kind_candidates->pop_back();
+	}
+	index.erase(entry->key);
+	entries.erase(entry);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::vector<MstrieCacheCandidate> *MstrieQueryCache::candidates(MstrieCacheEntry::Kind kind) {
+	using Kind = MstrieCacheEntry::Kind;
+	if (kind == Kind::search_sub || kind == Kind::retrieve_sub) return &sub_candidates;
+	if (kind == Kind::search_sup || kind == Kind::retrieve_sup) return &sup_candidates;
+	return nullptr;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint64_t MstrieQueryCache::support(const std::vector<uint> &multiset) {
+	uint64_t bits = 0;
+	for (size_t i = 0; i < multiset.size(); i++) {
+		if (multiset[i] > 0) bits |= uint64_t(1) << (i % 64);
+	}
+	return bits;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieQueryCache::affected(const MstrieCacheEntry &entry, const std::vector<uint> &multiset, bool insert) {
+	using Kind = MstrieCacheEntry::Kind;
+	// a search stays found after an insertion and stays not found after a deletion
+	if (entry.kind == Kind::search_exact || entry.kind == Kind::search_sub || entry.kind == Kind::search_sup) {
+		if (entry.found == insert) return false;
+	}
+	bool in_result = true;
+	if (entry.kind == Kind::search_exact) {
+		in_result = entry.multiset == multiset;
+	}
+	else if (entry.kind == Kind::search_sub || entry.kind == Kind::retrieve_sub) {
+		for (size_t i = 0; i < multiset.size() && in_result; i++) {
+			in_result = multiset[i] <= entry.multiset[i] && entry.multiset[i] - multiset[i] <= entry.limit;
+		}
+	}
+	else {
+		for (size_t i = 0; i < multiset.size() && in_result; i++) {
+			in_result = multiset[i] >= entry.multiset[i] && multiset[i] - entry.multiset[i] <= entry.limit;
+		}
+	}
+	return in_result;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieQueryCache::invalidate(const std::vector<uint> &multiset, bool insert) {
+	uint cardinality = std::accumulate(multiset.begin(), multiset.end(), 0u);
+	uint64_t bits = support(multiset);
+	std::lock_guard<std::mutex> lock(mutex);
+	// an exact search is affected only by its own multiset
+	auto exact = index.find(make_key(MstrieCacheEntry::Kind::search_exact, multiset, 0));
+	if (exact != index.end() && affected(*exact->second, multiset, insert)) {
+		erase(exact->second);
+		invalidations++;
+	}
+	// the multiset is a submultiset only of multisets of at least its cardinality and elements,
+	// an erased candidate is replaced by the last one, which is tested next
+	for (size_t i = 0; i < sub_candidates.size(); ) {
+		const MstrieCacheCandidate &candidate = sub_candidates[i];
+		if (candidate.cardinality >= cardinality && (bits & ~candidate.support) == 0 && affected(*candidate.entry, multiset, insert)) {
+			erase(candidate.entry);
+			invalidations++;
+		}
+		else i++;
+	}
+	// and a supermultiset only of multisets of at most its cardinality and elements
+	for (size_t i = 0; i < sup_candidates.size(); ) {
+		const MstrieCacheCandidate &candidate = sup_candidates[i];
+		if (candidate.cardinality <= cardinality && (candidate.support & ~bits) == 0 && affected(*candidate.entry, multiset, insert)) {
+			erase(candidate.entry);
+			invalidations++;
+		}
+		else i++;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieQueryCache::clear() {
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+	index.clear();
+	sub_candidates.clear();
+	sup_candidates.clear();
+	used = 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieQueryCache::print_stats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	std::string stats = "Cache: ";
+	stats += "entries: " + std::to_string(entries.size());
+	stats += "; bytes: " + std::to_string(used) + "/" + std::to_string(budget);
+	stats += "; hits: " + std::to_string(hits);
+	stats += "; misses: " + std::to_string(misses);
+	if (hits + misses > 0) {
+		stats += " (hit ratio " + std::to_string(hits * 100 / (hits + misses)) + "%)";
+	}
+	stats += "; evictions: " + std::to_string(evictions);
+	stats += "; invalidations: " + std::to_string(invalidations);
+	stats += "\n";
+	return stats;
+}
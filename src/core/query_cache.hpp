@@ -0,0 +1,102 @@
+//
+//  query_cache.hpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#ifndef QUERY_CACHE_HPP
+#define QUERY_CACHE_HPP
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/* Cached result of a query */
+class MstrieCacheEntry {
+public:
+	enum class Kind : uint8_t { search_exact, search_sub, search_sup, retrieve_sub, retrieve_sup };
+	
+	std::string key;
+	Kind kind;
+	// the query multiset as a multiplicity vector and the limit of the query
+	std::vector<uint> multiset;
+	uint limit;
+	// result of a search
+	bool found;
+	// result of a retrieval
+	std::string result;
+	// bytes charged to the budget of the cache
+	size_t bytes;
+	// position among the candidates of its kind, unused for exact searches
+	size_t candidate;
+};
+
+/* Coarse signature of a cached submultiset or supermultiset query
+ *
+ * The signatures are kept apart from the entries, so an invalidation
+ * rejects most entries without touching them.
+ */
+class MstrieCacheCandidate {
+public:
+	// bit i % 64 is set for every element i of the multiset
+	uint64_t support;
+	uint cardinality;
+	std::list<MstrieCacheEntry>::iterator entry;
+};
+
+/* Least recently used results of queries within a byte budget
+ *
+ * Entries are keyed by the multiplicity vector of the query, its kind and
+ * its limit, so different notations of the same multiset share an entry.
+ * An update of a multiset evicts only the entries whose result could
+ * contain it: the submultiset queries of its supermultisets and the
+ * supermultiset queries of its submultisets within their limit.
+ * An exact search is found by its key, the submultiset and supermultiset
+ * queries are tested only if their cardinality and elements allow them to
+ * contain the updated multiset.
+ *
+ * A lookup reorders the entries, so every operation takes a lock and
+ * queries that run concurrently can share the cache.
+ */
+class MstrieQueryCache {
+private:
+	const size_t budget;
+	mutable std::mutex mutex;
+	size_t used;
+	// the most recently used entry first
+	std::list<MstrieCacheEntry> entries;
+	std::unordered_map<std::string, std::list<MstrieCacheEntry>::iterator> index;
+	// signatures of the submultiset and of the supermultiset queries
+	std::vector<MstrieCacheCandidate> sub_candidates;
+	std::vector<MstrieCacheCandidate> sup_candidates;
+	
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	unsigned long invalidations;
+	
+	void erase(std::list<MstrieCacheEntry>::iterator entry);
+	// the candidates that hold entries of the kind, nullptr for exact searches
+	std::vector<MstrieCacheCandidate> *candidates(MstrieCacheEntry::Kind kind);
+	static uint64_t support(const std::vector<uint> &multiset);
+	// whether the result of the entry could change when the multiset is inserted or deleted
+	static bool affected(const MstrieCacheEntry &entry, const std::vector<uint> &multiset, bool insert);
+public:
+	MstrieQueryCache(size_t budget);
+	
+	static std::string make_key(MstrieCacheEntry::Kind kind, const std::vector<uint> &multiset, uint limit);
+	// copies the result of the key to found and result, false if it is not cached
+	bool lookup(const std::string &key, bool &found, std::string &result);
+	void store(const std::string &key, MstrieCacheEntry::Kind kind, const std::vector<uint> &multiset, uint limit, bool found, const std::string &result = "");
+	// evicts the entries whose result could change by the update of the multiset
+	void invalidate(const std::vector<uint> &multiset, bool insert);
+	void clear();
+	std::string print_stats() const;
+};
+
+#endif /* QUERY_CACHE_HPP */
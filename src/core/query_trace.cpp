@@ -0,0 +1,123 @@
+//
+//  query_trace.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+#include "query_trace.hpp"
+
+std::atomic<bool> QueryTrace::active(false);
+std::mutex QueryTrace::registry_mutex;
+std::vector<std::shared_ptr<TraceRing>> QueryTrace::rings;
+size_t QueryTrace::ring_capacity = QueryTrace::default_capacity;
+std::atomic<uint64_t> QueryTrace::generation(0);
+std::atomic<int64_t> QueryTrace::origin(0);
+thread_local std::shared_ptr<TraceRing> QueryTrace::thread_ring;
+thread_local uint64_t QueryTrace::thread_generation = 0;
+
+
+TraceRing::TraceRing(uint thread_id, size_t capacity)
+: thread_id(thread_id),
+events(std::max<size_t>(1, capacity)),
+head(0) {
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+int64_t QueryTrace::steady_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void QueryTrace::register_thread() {
+	thread_ring = std::make_shared<TraceRing>(static_cast<uint>(rings.size() + 1), ring_capacity);
+	thread_generation = generation.load();
+	rings.push_back(thread_ring);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void QueryTrace::start(size_t capacity) {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	rings.clear();
+	ring_capacity = capacity;
+	origin.store(steady_ns());
+	generation++;
+	register_thread();
+	active.store(true);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void QueryTrace::stop() {
+	active.store(false);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint64_t QueryTrace::now() {
+	return static_cast<uint64_t>(std::max<int64_t>(0, steady_ns() - origin.load(std::memory_order_relaxed)));
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void QueryTrace::record(const char *name, uint64_t start, uint64_t end) {
+	if (!enabled()) return;
+	if (thread_generation != generation.load(std::memory_order_acquire)) {
+		// the first span of the thread since tracing was started registers its ring
+		std::lock_guard<std::mutex> lock(registry_mutex);
+		register_thread();
+	}
+	TraceRing &ring = *thread_ring;
+	uint64_t head = ring.head.load(std::memory_order_relaxed);
+	TraceEvent &event = ring.events[head % ring.events.size()];
+	event.name = name;
+	event.start = start;
+	event.duration = end > start ? end - start : 0;
+	ring.head.store(head + 1, std::memory_order_release);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string QueryTrace::export_json() {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	std::string json = "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+	char buffer[256];
+	bool first = true;
+	auto pid = static_cast<int>(getpid());
+	for (auto &ring : rings) {
+		snprintf(buffer, sizeof(buffer), "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %u, \"args\": {\"name\": \"thread %u\"}}",
+			first ? "" : ",", pid, ring->thread_id, ring->thread_id);
+		json += buffer;
+		first = false;
+		uint64_t head = ring->head.load(std::memory_order_acquire);
+		uint64_t size = ring->events.size();
+		for (uint64_t i = head > size ? head - size : 0; i < head; i++) {
+			auto &event = ring->events[i % size];
+			// the timestamps of trace events are in microseconds
+			snprintf(buffer, sizeof(buffer), ",\n{\"name\": \"%s\", \"cat\": \"mstrie\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %d, \"tid\": %u}",
+				event.name, event.start / 1000.0, event.duration / 1000.0, pid, ring->thread_id);
+			json += buffer;
+		}
+	}
+	json += "\n]}\n";
+	return json;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+size_t QueryTrace::size() {
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	size_t total = 0;
+	for (auto &ring : rings) {
+		total += std::min<uint64_t>(ring->head.load(std::memory_order_acquire), ring->events.size());
+	}
+	return total;
+}
@@ -0,0 +1,106 @@
+//
+//  query_trace.hpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#ifndef QUERY_TRACE_HPP
+#define QUERY_TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/* Finished span of a traced thread */
+class TraceEvent {
+public:
+	// string literal, the name is not copied
+	const char *name;
+	// nanoseconds since tracing was started
+	uint64_t start;
+	uint64_t duration;
+};
+
+/* Ring buffer with the spans of one thread
+ *
+ * Only the owning thread writes, so recording does not take a lock. When
+ * the buffer is full the oldest spans are overwritten.
+ */
+class TraceRing {
+public:
+	const uint thread_id;
+	std::vector<TraceEvent> events;
+	// number of spans ever recorded, the next one goes to head % size
+	std::atomic<uint64_t> head;
+
+	TraceRing(uint thread_id, size_t capacity);
+};
+
+/* Spans of query execution exported as Chrome trace events
+ *
+ * Tracing is off by default and a span then costs one relaxed load.
+ * Every thread records into its own ring, the rings are collected
+ * on export, which should be done while the traced threads are idle.
+ */
+class QueryTrace {
+public:
+	// spans kept per thread
+	static const size_t default_capacity = 1 << 16;
+
+	// the spans recorded before are dropped, the ring of the calling thread is allocated at once
+	static void start(size_t capacity = default_capacity);
+	static void stop();
+	static bool enabled() {
+		return active.load(std::memory_order_relaxed);
+	}
+	// nanoseconds since tracing was started
+	static uint64_t now();
+	static void record(const char *name, uint64_t start, uint64_t end);
+	// trace event format, loadable by chrome://tracing and Perfetto
+	static std::string export_json();
+	// number of spans held by all threads
+	static size_t size();
+private:
+	static std::atomic<bool> active;
+	
+	// rings of the threads that recorded since tracing was started
+	static std::mutex registry_mutex;
+	static std::vector<std::shared_ptr<TraceRing>> rings;
+	static size_t ring_capacity;
+	// a thread takes a new ring when tracing was restarted
+	static std::atomic<uint64_t> generation;
+	// steady clock time tracing was started, in nanoseconds
+	static std::atomic<int64_t> origin;
+	
+	static thread_local std::shared_ptr<TraceRing> thread_ring;
+	static thread_local uint64_t thread_generation;
+	
+	static int64_t steady_ns();
+	// creates the ring of the calling thread, to be called with registry_mutex held
+	static void register_thread();
+};
+
+/* Records the time from its construction to its destruction as a span */
+class TraceSpan {
+private:
+	const char *name;
+	uint64_t start;
+public:
+	TraceSpan(const char *name)
+	: name(QueryTrace::enabled() ? name : nullptr),
+	start(this->name != nullptr ? QueryTrace::now() : 0) { }
+
+	~TraceSpan() {
+		if (name != nullptr) QueryTrace::record(name, start, QueryTrace::now());
+	}
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+#endif /* QUERY_TRACE_HPP */
@@ -0,0 +1,364 @@
+//
+//  write_ahead_log.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include "write_ahead_log.hpp"
+#include "mstrie.hpp"
+#include "../utils/file_utils.hpp"
+
+
+MstrieWalSettings::MstrieWalSettings(bool enabled, SyncPolicy sync_policy, uint group_size, uint checkpoint_interval, uint group_delay_ms)
+: enabled(enabled),
+sync_policy(sync_policy),
+group_size(group_size > 0 ? group_size : 1),
+checkpoint_interval(checkpoint_interval),
+group_delay_ms(group_delay_ms) {};
+
+// -----------------------------------------------------------------------------------------------
+
+MstrieWalSettings::SyncPolicy MstrieWalSettings::parse_sync_policy(const std::string &policy) {
+	if (policy.compare("never") == 0) {
+		return SyncPolicy::never;
+	}
+	else if (policy.compare("group") == 0) {
+		return SyncPolicy::group;
+	}
+	else if (policy.compare("always") == 0) {
+		return SyncPolicy::always;
+	}
+	throw MstrieStructure::MstrieException("Unknown write-ahead log sync policy: " + policy);
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+MstrieWal::MstrieWal(const std::string &path, const MstrieWalSettings &settings)
+: _path(path),
+_rotated_path(path + ".old"),
+_settings(settings) {
+	this->fd = -1;
+	this->lsn = 0;
+	this->records_since_checkpoint = 0;
+	this->stopping = false;
+	this->unsynced_records = 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+MstrieWal::~MstrieWal() {
+	if (sync_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(file_mutex);
+			stopping = true;
+		}
+		sync_cv.notify_one();
+		sync_thread.join();
+	}
+	try {
+		close();
+	} catch (std::exception &e) {
+		// nothing can be done at this point
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string MstrieWal::read_segment(const std::string &path) {
+	if (!FileUtils::file_exists(path)) {
+		return "";
+	}
+	// the content after the last line break is a record torn by a crash, it was never acknowledged
+	std::string content = FileUtils::read_from_file(path);
+	return content.substr(0, content.find_last_of('\n') + 1);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+unsigned long long MstrieWal::replay(unsigned long long checkpoint_lsn, const std::function<void(const std::string&, const std::string&)> &apply) {
+	unsigned long long last_applied = checkpoint_lsn;
+	// the rotated segment holds the older records
+	std::string content = read_segment(_rotated_path) + read_segment(_path);
+	size_t start = 0;
+	size_t end;
+	while ((end = content.find('\n', start)) != std::string::npos) {
+		std::istringstream record(content.substr(start, end - start));
+		start = end + 1;
+
+		unsigned long long record_lsn;
+		std::string query_type, word;
+		if (!(record >> record_lsn >> query_type >> word)) {
+			throw MstrieStructure::MstrieException("Corrupted write-ahead log record in " + _path + " after lsn " + std::to_string(last_applied));
+		}
+		// the record is already in the checkpoint
+		if (record_lsn <= last_applied) continue;
+		try {
+			apply(query_type, word);
+		} catch (std::exception &e) {
+			throw MstrieStructure::MstrieException("Replay of write-ahead log record " + std::to_string(record_lsn) + " failed: " + std::string(e.what()));
+		}
+		last_applied = record_lsn;
+		records_since_checkpoint++;
+	}
+	return last_applied;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::open(unsigned long long last_lsn) {
+	{
+		std::lock_guard<std::mutex> lock(file_mutex);
+		close_file();
+		// both segments are merged into one without a torn tail before appending
+		FileUtils::replace_file(_path, read_segment(_rotated_path) + read_segment(_path));
+		release_rotated();
+		open_file();
+		lsn = last_lsn;
+	}
+	if (_settings.sync_policy == MstrieWalSettings::SyncPolicy::group && _settings.group_delay_ms > 0 && !sync_thread.joinable()) {
+		sync_thread = std::thread(&MstrieWal::run_sync_thread, this);
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::open_file() {
+	fd = ::open(_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (fd < 0) {
+		throw std::runtime_error("ERROR: File " + _path + " can't be opened.");
+	}
+	// the segment may have just been created after a rotation, a synced record must not lose its file
+	FileUtils::sync_directory(_path);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::close() {
+	std::lock_guard<std::mutex> lock(file_mutex);
+	close_file();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::close_file() {
+	if (fd < 0) return;
+	if (unsynced_records > 0) sync_file();
+	::close(fd);
+	fd = -1;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::check_sync_error() {
+	if (!sync_error.empty()) {
+		std::string error = sync_error;
+		sync_error.clear();
+		throw std::runtime_error(error);
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::append(const std::string &query_type, const std::string &word) {
+	std::lock_guard<std::mutex> lock(file_mutex);
+	check_sync_error();
+	buffer += std::to_string(++lsn);
+	buffer += ' ';
+	buffer += query_type;
+	buffer += ' ';
+	buffer += word;
+	buffer += '\n';
+	// the record reaches the file before the update is applied, only its sync may wait
+	write_records(1, false);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::append_group(const std::vector<std::pair<std::string, std::string>> &updates) {
+	if (updates.empty()) return;
+	std::lock_guard<std::mutex> lock(file_mutex);
+	check_sync_error();
+	for (auto &update : updates) {
+		buffer += std::to_string(++lsn);
+		buffer += ' ';
+		buffer += update.first;
+		buffer += ' ';
+		buffer += update.second;
+		buffer += '\n';
+	}
+	// the batch is its own group
+	write_records(updates.size(), true);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::write_records(uint records, bool own_group) {
+	if (fd < 0) {
+		buffer.clear();
+		lsn -= records;
+		throw std::runtime_error("ERROR: Write-ahead log " + _path + " is not open.");
+	}
+	// the end of the file before the records, where they are cut off if they fail
+	off_t size = lseek(fd, 0, SEEK_END);
+	bool written = false;
+	try {
+		write_buffer();
+		written = true;
+		if (own_group) {
+			unsynced_records += records;
+			if (_settings.sync_policy != MstrieWalSettings::SyncPolicy::never) {
+				sync_file();
+			}
+		}
+		else {
+			commit_records(records);
+		}
+	} catch (std::exception &e) {
+		buffer.clear();
+		lsn -= records;
+		if (written) unsynced_records -= std::min(unsynced_records, records);
+		if (size < 0 || ftruncate(fd, size) != 0) {
+			throw std::runtime_error(std::string(e.what()) + " Its records can't be removed and may be replayed.");
+		}
+		throw;
+	}
+	records_since_checkpoint += records;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::commit_records(uint records) {
+	if (_settings.sync_policy == MstrieWalSettings::SyncPolicy::never) return;
+	if (unsynced_records == 0) {
+		first_unsynced = std::chrono::steady_clock::now();
+		// the sync thread starts waiting for the delay of the group
+		sync_cv.notify_one();
+	}
+	unsynced_records += records;
+	if (_settings.sync_policy == MstrieWalSettings::SyncPolicy::always || unsynced_records >= _settings.group_size) {
+		sync_file();
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::run_sync_thread() {
+	std::unique_lock<std::mutex> lock(file_mutex);
+	while (!stopping) {
+		if (unsynced_records == 0) {
+			sync_cv.wait(lock);
+			continue;
+		}
+		auto deadline = first_unsynced + std::chrono::milliseconds(_settings.group_delay_ms);
+		if (std::chrono::steady_clock::now() < deadline) {
+			sync_cv.wait_until(lock, deadline);
+			continue;
+		}
+		try {
+			sync_file();
+		} catch (std::exception &e) {
+			sync_error = e.what();
+			// the records stay unsynced, the error is reported by the next append
+			sync_cv.wait(lock);
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::write_buffer() {
+	if (fd < 0) {
+		throw std::runtime_error("ERROR: Write-ahead log " + _path + " is not open.");
+	}
+	const char *data = buffer.data();
+	size_t left = buffer.size();
+	while (left > 0) {
+		ssize_t written = ::write(fd, data, left);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			throw std::runtime_error("ERROR: Write-ahead log " + _path + " can't be written.");
+		}
+		data += written;
+		left -= written;
+	}
+	buffer.clear();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::sync_file() {
+	if (_settings.sync_policy != MstrieWalSettings::SyncPolicy::never && fd >= 0) {
+		if (fdatasync(fd) != 0) {
+			throw std::runtime_error("ERROR: Write-ahead log " + _path + " can't be synced.");
+		}
+	}
+	unsynced_records = 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::sync() {
+	std::lock_guard<std::mutex> lock(file_mutex);
+	sync_file();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::reset() {
+	std::lock_guard<std::mutex> lock(file_mutex);
+	unsynced_records = 0;
+	records_since_checkpoint = 0;
+	if (fd >= 0 && ftruncate(fd, 0) != 0) {
+		throw std::runtime_error("ERROR: Write-ahead log " + _path + " can't be truncated.");
+	}
+	release_rotated();
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::rotate() {
+	std::lock_guard<std::mutex> lock(file_mutex);
+	close_file();
+	if (FileUtils::file_exists(_rotated_path)) {
+		// the previous checkpoint was not persisted, its records are still needed
+		FileUtils::replace_file(_rotated_path, read_segment(_rotated_path) + read_segment(_path));
+		if (unlink(_path.c_str()) != 0) {
+			throw std::runtime_error("ERROR: Write-ahead log " + _path + " can't be removed.");
+		}
+	}
+	else if (rename(_path.c_str(), _rotated_path.c_str()) != 0) {
+		throw std::runtime_error("ERROR: Write-ahead log " + _path + " can't be rotated.");
+	}
+	// syncs the directory with the rename before the checkpoint can release the records
+	open_file();
+	records_since_checkpoint = 0;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void MstrieWal::release_rotated() {
+	if (FileUtils::file_exists(_rotated_path) && unlink(_rotated_path.c_str()) != 0) {
+		throw std::runtime_error("ERROR: Write-ahead log " + _rotated_path + " can't be removed.");
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+unsigned long long MstrieWal::last_lsn() const {
+	return lsn;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool MstrieWal::checkpoint_due() const {
+	return _settings.checkpoint_interval > 0 && records_since_checkpoint >= _settings.checkpoint_interval;
+}
@@ -0,0 +1,132 @@
+//
+//  write_ahead_log.hpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#ifndef WRITE_AHEAD_LOG_HPP
+#define WRITE_AHEAD_LOG_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/* The write-ahead log settings */
+class MstrieWalSettings {
+public:
+	// when the log is synced to disk
+	enum class SyncPolicy {
+		// never call fsync, the records are only handed to the OS
+		never,
+		// call fsync once per group of records
+		group,
+		// call fsync for every record
+		always
+	};
+
+	// the log is written only if enabled
+	bool enabled;
+	SyncPolicy sync_policy;
+	// the number of records synced together
+	uint group_size;
+	// the number of records after which a checkpoint is taken, 0 - never
+	uint checkpoint_interval;
+	// the longest time a written record waits for the sync of its group, 0 - until the group is full
+	uint group_delay_ms;
+
+	MstrieWalSettings(bool enabled = false, SyncPolicy sync_policy = SyncPolicy::group, uint group_size = 64, uint checkpoint_interval = 0, uint group_delay_ms = 10);
+
+	static SyncPolicy parse_sync_policy(const std::string &policy);
+};
+
+/* Append-only log of update queries
+ *
+ * Every record has the form "<lsn> <+|-> <word>\n", where lsn is a
+ * sequence number that grows by one with every record. A checkpoint
+ * stores the lsn of the last record it contains, so the records with
+ * a greater lsn are the only ones to be replayed on top of it.
+ *
+ * While a checkpoint is being taken, the records it contains are kept
+ * in a rotated segment "<path>.old" until the checkpoint is persisted.
+ *
+ * Every record is written to the file when it is appended, so it survives
+ * a crash of the process; only the sync is shared by a group. A partial
+ * group is synced by another thread once its first record has waited for
+ * group_delay_ms. The records of an append that fails to be written or
+ * synced are cut off the file again, so they are not replayed.
+ */
+class MstrieWal {
+private:
+	const std::string _path;
+	const std::string _rotated_path;
+	const MstrieWalSettings _settings;
+
+	int fd;
+	// the last lsn handed out
+	unsigned long long lsn;
+	// records being written
+	std::string buffer;
+	// records written since the last checkpoint
+	uint records_since_checkpoint;
+
+	// guards the file and the unsynced records against the sync thread
+	std::mutex file_mutex;
+	std::condition_variable sync_cv;
+	std::thread sync_thread;
+	bool stopping;
+	// records written and not yet synced, the first one since first_unsynced
+	uint unsynced_records;
+	std::chrono::steady_clock::time_point first_unsynced;
+	// failure of the sync thread, reported by the next append
+	std::string sync_error;
+
+	// the following are called with file_mutex held
+	void write_buffer();
+	void sync_file();
+	// syncs the records according to the sync policy
+	void commit_records(uint records);
+	// writes the last records in the buffer and commits them, with their own sync if own_group;
+	// removes them from the file and from the lsn sequence if either fails
+	void write_records(uint records, bool own_group);
+	void open_file();
+	void close_file();
+	void check_sync_error();
+
+	// syncs a partial group once its delay has passed
+	void run_sync_thread();
+	// reads records of a segment without a torn tail
+	std::string read_segment(const std::string &path);
+public:
+	MstrieWal(const std::string &path, const MstrieWalSettings &settings);
+	~MstrieWal();
+
+	// applies records with lsn greater than checkpoint_lsn, returns the last applied lsn
+	unsigned long long replay(unsigned long long checkpoint_lsn, const std::function<void(const std::string&, const std::string&)> &apply);
+	// opens the log for appending, new records will follow last_lsn
+	void open(unsigned long long last_lsn);
+	void close();
+
+	// appends a record, the record is durable according to the sync policy
+	void append(const std::string &query_type, const std::string &word);
+	// appends the records of updates and commits them together, with one sync at most
+	void append_group(const std::vector<std::pair<std::string, std::string>> &updates);
+	// syncs all appended records
+	void sync();
+	// discards all records, to be called once a checkpoint is persisted
+	void reset();
+	// moves the records to the rotated segment, to be called when a checkpoint is started
+	void rotate();
+	// discards the rotated segment, to be called once the checkpoint is persisted
+	void release_rotated();
+
+	unsigned long long last_lsn() const;
+	bool checkpoint_due() const;
+};
+
+#endif /* WRITE_AHEAD_LOG_HPP */
@@ -116,3 +116,19 @@ void Configurator::set_value(const std::string &parameter_identifier, const std:
     }
     current_config_group->parameters[ids[n - 1]] = parameter_value;
 }
+
+// -----------------------------------------------------------------------------------------------
+
+bool Configurator::has_value(const std::string &parameter_identifier) {
+    auto ids = this->parse_parameter_identifier(parameter_identifier);
+    
+    std::shared_ptr<Config> current_config_group = this->config;
+    size_t n = ids.size();
+    for (size_t i = 0; i < n - 1; i++) {
+        if (current_config_group->groups.find(ids[i]) == current_config_group->groups.end()) {
+            return false;
+        }
+        current_config_group = current_config_group->groups[ids[i]];
+    }
+    return current_config_group->parameters.find(ids[n - 1]) != current_config_group->parameters.end();
+}
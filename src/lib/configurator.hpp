@@ -81,6 +81,17 @@ public:
             throw Configurator::ConfigurationException("Could not find configuration parameter: " + ids[n - 1]);
         return convert_to<T>(current_config_group->parameters[ids[n - 1]]);
     }
+    
+    // check if parameter is present in configuration
+    bool has_value(const std::string &parameter_identifier);
+    
+    // get optional parameter, default value is returned if parameter is absent
+    template <typename T>
+    T get_value(const std::string &parameter_identifier, const T &default_value){
+        if (!has_value(parameter_identifier))
+            return default_value;
+        return get_value<T>(parameter_identifier);
+    }
 };
 
 #pragma GCC visibility pop
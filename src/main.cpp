@@ -10,6 +10,7 @@
 #include <iostream>
 #include "cli/cli.hpp"
 #include "benchmark/benchmark.hpp"
+#include "server/server.hpp"
 #include "lib/configurator.hpp"
 
 
@@ -26,7 +27,10 @@ int main(int argc, const char * argv[]) {
 		Configurator config = Configurator(configuration_file);
 		std::string run_mode = config.get_value<std::string>("run_mode");
 		
-		std::cout<<"Mstrie 0.1"<<std::endl;
+		// the output of the batch mode holds only the results of its commands
+		if (run_mode.compare("batch") != 0) {
+			std::cout<<"Mstrie 0.1"<<std::endl;
+		}
 		if (run_mode.compare("benchmark") == 0) {
 			std::cout<<"Running benchmark..."<<std::endl;
 			std::unique_ptr<Benchmark> benchmark = std::make_unique<Benchmark>(config);
@@ -39,6 +43,15 @@ int main(int argc, const char * argv[]) {
 			std::unique_ptr<Cli> cli = std::make_unique<Cli>(config, config.get_value<std::string>("default_mstrie_name"));
 			cli->command_loop();
 		}
+		else if (run_mode.compare("batch") == 0) {
+			std::unique_ptr<Cli> cli = std::make_unique<Cli>(config, config.get_value<std::string>("default_mstrie_name"));
+			cli->batch_loop(CliBatchSettings::from_config(config));
+		}
+		else if (run_mode.compare("server") == 0) {
+			std::unique_ptr<Server> server = std::make_unique<Server>(config);
+			server->run();
+			std::cout<<"Done."<<std::endl;
+		}
 		else {
 			std::cerr<<"Unknown run mode for mstrie."<<std::endl;
 			return EXIT_FAILURE;
@@ -0,0 +1,567 @@
+//
+//  server.cpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "server.hpp"
+
+// epoll data of the descriptors that are not connections
+static const uint64_t listen_event = 0;
+static const uint64_t wake_event = 1;
+static const uint64_t signal_event = 2;
+
+
+uint32_t ServerProtocol::read_u32(const char *data) {
+	auto bytes = reinterpret_cast<const unsigned char*>(data);
+	return (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void ServerProtocol::append_u32(std::string &frame, uint32_t value) {
+	frame += static_cast<char>(value >> 24);
+	frame += static_cast<char>(value >> 16);
+	frame += static_cast<char>(value >> 8);
+	frame += static_cast<char>(value);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string ServerProtocol::query_type(uint8_t code) {
+	switch (code) {
+		case 1: return "=";
+		case 2: return "<=";
+		case 3: return ">=";
+		case 4: return "+";
+		case 5: return "-";
+		default: return "";
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string ServerProtocol::encode_response(uint32_t id, Status status, const std::string &body) {
+	std::string frame;
+	frame.reserve(9 + body.size());
+	append_u32(frame, static_cast<uint32_t>(5 + body.size()));
+	append_u32(frame, id);
+	frame += static_cast<char>(status);
+	frame += body;
+	return frame;
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+ServerConnection::ServerConnection(int fd)
+: fd(fd),
+output_offset(0),
+next_request(0),
+next_response(0),
+closing(false),
+events(0) {
+}
+
+// -----------------------------------------------------------------------------------------------
+
+uint64_t ServerConnection::in_flight() const {
+	return next_request - next_response;
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+Server::Server(const Configurator &config) {
+	this->config = std::make_unique<Configurator>(config);
+	// the statistics of the last query are not served, not recording them lets the queries run concurrently
+	this->manager = MstrieManager::from_config(*this->config, this->config->get_value<std::string>("server:mstrie_name"), "none");
+	this->listen_address = this->config->get_value<std::string>("server:listen", "tcp:127.0.0.1:7070");
+	this->workers = this->config->get_value<uint>("server:workers", 0);
+	if (this->workers == 0) {
+		this->workers = std::max(1u, std::thread::hardware_concurrency());
+	}
+	this->max_frame = this->config->get_value<size_t>("server:max_frame", 16 << 20);
+	this->max_pipeline = std::max<size_t>(1, this->config->get_value<size_t>("server:max_pipeline", 1024));
+	this->epoll_fd = -1;
+	this->listen_fd = -1;
+	this->wake_fd = -1;
+	this->signal_fd = -1;
+	this->next_connection = signal_event + 1;
+	this->stopping = false;
+	this->concurrent_queries = false;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+Server::~Server() {
+	{
+		std::lock_guard<std::mutex> lock(requests_mutex);
+		stopping = true;
+	}
+	requests_cv.notify_all();
+	for (auto &worker : worker_threads) {
+		worker.join();
+	}
+	for (auto &connection : connections) {
+		close(connection.second.fd);
+	}
+	for (int fd : { epoll_fd, listen_fd, wake_fd, signal_fd }) {
+		if (fd >= 0) close(fd);
+	}
+	if (!unix_path.empty()) {
+		unlink(unix_path.c_str());
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Server::run() {
+	/* the signals are taken from a descriptor, the workers and the threads of the manager inherit the mask */
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+
+	manager->init_index();
+	concurrent_queries = manager->concurrent_queries();
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (epoll_fd < 0 || signal_fd < 0 || wake_fd < 0) {
+		throw std::runtime_error("Server event loop can't be created: " + std::string(strerror(errno)));
+	}
+	open_listener();
+	for (auto fd_event : { std::make_pair(listen_fd, listen_event), std::make_pair(wake_fd, wake_event), std::make_pair(signal_fd, signal_event) }) {
+		epoll_event event;
+		event.events = EPOLLIN;
+		event.data.u64 = fd_event.second;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd_event.first, &event) < 0) {
+			throw std::runtime_error("Server event loop can't be created: " + std::string(strerror(errno)));
+		}
+	}
+	for (uint i = 0; i < workers; i++) {
+		worker_threads.emplace_back(&Server::work, this);
+	}
+
+	/* event loop */
+	bool running = true;
+	epoll_event events[64];
+	while (running) {
+		int n = epoll_wait(epoll_fd, events, 64, -1);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			throw std::runtime_error("Server event loop failed: " + std::string(strerror(errno)));
+		}
+		for (int i = 0; i < n; i++) {
+			uint64_t id = events[i].data.u64;
+			if (id == listen_event) {
+				accept_connections();
+			}
+			else if (id == wake_event) {
+				deliver_responses();
+			}
+			else if (id == signal_event) {
+				running = false;
+			}
+			else if (connections.find(id) != connections.end()) {
+				if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+					close_connection(id);
+					continue;
+				}
+				if (events[i].events & EPOLLIN) {
+					read_connection(id);
+				}
+				if ((events[i].events & EPOLLOUT) && connections.find(id) != connections.end()) {
+					write_connection(id);
+				}
+			}
+		}
+	}
+
+	std::cout<<"Stopping server..."<<std::endl;
+	{
+		std::lock_guard<std::mutex> lock(requests_mutex);
+		stopping = true;
+	}
+	requests_cv.notify_all();
+	for (auto &worker : worker_threads) {
+		worker.join();
+	}
+	worker_threads.clear();
+	manager->flush_index(true);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Server::open_listener() {
+	if (listen_address.compare(0, 4, "tcp:") == 0) {
+		auto host_port = listen_address.substr(4);
+		auto colon = host_port.rfind(':');
+		if (colon == std::string::npos) {
+			throw std::runtime_error("Listen address must be tcp:<host>:<port>: " + listen_address);
+		}
+		auto host = host_port.substr(0, colon);
+		auto port = host_port.substr(colon + 1);
+		// IPv6 addresses are written in brackets
+		if (host.size() >= 2 && host.front() == '[' && host.back() == ']') {
+			host = host.substr(1, host.size() - 2);
+		}
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags = AI_PASSIVE;
+		addrinfo *addresses = nullptr;
+		int status = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addresses);
+		if (status != 0) {
+			throw std::runtime_error("Listen address can't be resolved: " + listen_address + ": " + gai_strerror(status));
+		}
+		int error = 0;
+		for (auto address = addresses; address != nullptr && listen_fd < 0; address = address->ai_next) {
+			int fd = socket(address->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, address->ai_protocol);
+			if (fd < 0) {
+				error = errno;
+				continue;
+			}
+			int on = 1;
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+			if (bind(fd, address->ai_addr, address->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0) {
+				listen_fd = fd;
+			}
+			else {
+				error = errno;
+				close(fd);
+			}
+		}
+		freeaddrinfo(addresses);
+		if (listen_fd < 0) {
+			throw std::runtime_error("Can't listen on " + listen_address + ": " + strerror(error));
+		}
+		// the port is chosen by the system if 0 is given
+		sockaddr_storage bound;
+		socklen_t bound_size = sizeof(bound);
+		char bound_host[NI_MAXHOST], bound_port[NI_MAXSERV];
+		if (getsockname(listen_fd, reinterpret_cast<sockaddr*>(&bound), &bound_size) == 0 &&
+				getnameinfo(reinterpret_cast<sockaddr*>(&bound), bound_size, bound_host, sizeof(bound_host), bound_port, sizeof(bound_port), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+			std::cout<<"Listening on tcp:"<<bound_host<<":"<<bound_port<<std::endl;
+		}
+	}
+	else if (listen_address.compare(0, 5, "unix:") == 0) {
+		auto path = listen_address.substr(5);
+		sockaddr_un address;
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+			throw std::runtime_error("Unix socket path is empty or too long: " + path);
+		}
+		strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+		// a socket left by a previous run is replaced, other files are not
+		struct stat file;
+		if (stat(path.c_str(), &file) == 0 && S_ISSOCK(file.st_mode)) {
+			unlink(path.c_str());
+		}
+		listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+			throw std::runtime_error("Can't listen on " + listen_address + ": " + strerror(errno));
+		}
+		unix_path = path;
+		std::cout<<"Listening on "<<listen_address<<std::endl;
+	}
+	else {
+		throw std::runtime_error("Unknown listen address: " + listen_address);
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Server::accept_connections() {
+	while (true) {
+		int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				std::cerr<<"Connection can't be accepted: "<<strerror(errno)<<std::endl;
+			}
+			return;
+		}
+		// the responses are small, they are sent at once; fails on Unix sockets
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		uint64_t id = next_connection++;
+		auto &connection = connections.emplace(id, ServerConnection(fd)).first->second;
+		connection.events = EPOLLIN;
+		epoll_event event;
+		event.events = connection.events;
+		event.data.u64 = id;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+			close(fd);
+			connections.erase(id);
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Server::read_connection(uint64_t id) {
+	auto &connection = connections.at(id);
+	char buffer[1 << 16];
+	while (!connection.closing && connection.in_flight() < max_pipeline) {
+		ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+		if (n > 0) {
+			connection.input.append(buffer, n);
+			if (!decode_requests(id, connection)) return;
+		}
+		else if (n == 0) {
+			connection.closing = true;
+		}
+		else if (errno == EINTR) {
+			continue;
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			break;
+		}
+		else {
+			close_connection(id);
+			return;
+		}
+	}
+	write_connection(id);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool Server::decode_requests(uint64_t id, ServerConnection &connection) {
+	std::vector<ServerRequest> decoded;
+	size_t offset = 0;
+	while (connection.in_flight() < max_pipeline && connection.input.size() - offset >= 4) {
+		uint32_t length = ServerProtocol::read_u32(connection.input.data() + offset);
+		if (length > max_frame) {
+			std::cerr<<"Frame of "<<length<<" bytes is above the limit, the connection is closed."<<std::endl;
+			close_connection(id);
+			return false;
+		}
+		if (connection.input.size() - offset - 4 < length) break;
+		const char *frame = connection.input.data() + offset + 4;
+		uint64_t sequence = connection.next_request++;
+		if (length < ServerProtocol::request_header - 4) {
+			connection.done[sequence] = ServerProtocol::encode_response(0, ServerProtocol::error, "Request frame is too short.");
+		}
+		else {
+			ServerRequest request;
+			request.connection = id;
+			request.sequence = sequence;
+			request.id = ServerProtocol::read_u32(frame);
+			request.operation = static_cast<uint8_t>(frame[4]);
+			request.query_type = ServerProtocol::query_type(static_cast<uint8_t>(frame[5]));
+			request.limit = static_cast<int32_t>(ServerProtocol::read_u32(frame + 6));
+			request.word.assign(frame + 10, length - 10);
+			decoded.push_back(std::move(request));
+		}
+		offset += 4 + length;
+	}
+	connection.input.erase(0, offset);
+	if (!decoded.empty()) {
+		bool schedule;
+		{
+			std::lock_guard<std::mutex> lock(requests_mutex);
+			auto &queue = pending[id];
+			// otherwise the worker of the earlier requests schedules the connection again
+			schedule = queue.empty();
+			if (schedule) ready.push(id);
+			for (auto &request : decoded) {
+				queue.push_back(std::move(request));
+			}
+		}
+		if (schedule) requests_cv.notify_one();
+	}
+	collect_responses(connection);
+	return true;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Server::collect_responses(ServerConnection &connection) {
+	for (auto it = connection.done.begin(); it != connection.done.end() && it->first == connection.next_response; it = connection.done.erase(it)) {
+		connection.output += it->second;
+		connection.next_response++;
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Server::write_connection(uint64_t id) {
+	auto &connection = connections.at(id);
+	while (connection.output_offset < connection.output.size()) {
+		ssize_t n = send(connection.fd, connection.output.data() + connection.output_offset, connection.output.size() - connection.output_offset, MSG_NOSIGNAL);
+		if (n >= 0) {
+			connection.output_offset += n;
+		}
+		else if (errno == EINTR) {
+			continue;
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			break;
+		}
+		else {
+			close_connection(id);
+			return;
+		}
+	}
+	if (connection.output_offset == connection.output.size()) {
+		connection.output.clear();
+		connection.output_offset = 0;
+	}
+	if (connection.closing && connection.in_flight() == 0 && connection.output.empty()) {
+		close_connection(id);
+		return;
+	}
+	update_events(id, connection);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Server::close_connection(uint64_t id) {
+	auto it = connections.find(id);
+	if (it == connections.end()) return;
+	// the responses of its requests in the workers are dropped when they are done
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+	close(it->second.fd);
+	connections.erase(it);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Server::update_events(uint64_t id, ServerConnection &connection) {
+	uint32_t events = 0;
+	if (!connection.closing && connection.in_flight() < max_pipeline) events |= EPOLLIN;
+	if (connection.output_offset < connection.output.size()) events |= EPOLLOUT;
+	if (events == connection.events) return;
+	epoll_event event;
+	event.events = events;
+	event.data.u64 = id;
+	epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection.fd, &event);
+	connection.events = events;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void Server::deliver_responses() {
+	uint64_t count;
+	while (read(wake_fd, &count, sizeof(count)) < 0 && errno == EINTR);
+	std::vector<ServerResponse> done;
+	{
+		std::lock_guard<std::mutex> lock(responses_mutex);
+		done.swap(responses);
+	}
+	std::set<uint64_t> touched;
+	for (auto &response : done) {
+		auto it = connections.find(response.connection);
+		if (it == connections.end()) continue;
+		it->second.done[response.sequence] = std::move(response.frame);
+		touched.insert(response.connection);
+	}
+	for (auto id : touched) {
+		auto &connection = connections.at(id);
+		collect_responses(connection);
+		// frames held back by a full pipeline
+		if (!decode_requests(id, connection)) continue;
+		write_connection(id);
+	}
+}
+
+// ===============================================================================================
+// ===============================================================================================
+
+void Server::work() {
+	while (true) {
+		ServerRequest request;
+		{
+			std::unique_lock<std::mutex> lock(requests_mutex);
+			requests_cv.wait(lock, [this]() { return !ready.empty() || stopping; });
+			if (stopping) return;
+			// the request stays first in its queue until it is executed
+			request = std::move(pending.at(ready.front()).front());
+			ready.pop();
+		}
+		ServerResponse response;
+		response.connection = request.connection;
+		response.sequence = request.sequence;
+		response.frame = execute(request);
+		{
+			std::lock_guard<std::mutex> lock(requests_mutex);
+			auto queue = pending.find(request.connection);
+			queue->second.pop_front();
+			if (queue->second.empty()) {
+				pending.erase(queue);
+			}
+			else {
+				// the next request of the connection may be taken by any worker
+				ready.push(request.connection);
+				requests_cv.notify_one();
+			}
+		}
+		bool wake;
+		{
+			std::lock_guard<std::mutex> lock(responses_mutex);
+			// the loop is woken by the first response it has not taken yet
+			wake = responses.empty();
+			responses.push_back(std::move(response));
+		}
+		if (wake) {
+			uint64_t one = 1;
+			while (write(wake_fd, &one, sizeof(one)) < 0 && errno == EINTR);
+		}
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+std::string Server::execute(const ServerRequest &request) {
+	std::string body;
+	try {
+		if (request.query_type.empty()) {
+			throw std::runtime_error("Unknown query type.");
+		}
+		std::unique_lock<std::shared_timed_mutex> exclusive(manager_mutex, std::defer_lock);
+		std::shared_lock<std::shared_timed_mutex> shared(manager_mutex, std::defer_lock);
+		if (request.operation == ServerProtocol::update || !concurrent_queries) exclusive.lock();
+		else shared.lock();
+		switch (request.operation) {
+			case ServerProtocol::search:
+				body = manager->search_query(request.query_type, request.word, request.limit) ? std::string(1, '\1') : std::string(1, '\0');
+				break;
+			case ServerProtocol::update:
+				manager->update_query(request.query_type, request.word);
+				break;
+			case ServerProtocol::retrieve:
+				body = manager->retrieve_query(request.query_type, request.word, request.limit);
+				break;
+			default:
+				throw std::runtime_error("Unknown operation: " + std::to_string(request.operation));
+		}
+	} catch (std::exception &e) {
+		return ServerProtocol::encode_response(request.id, ServerProtocol::error, e.what());
+	}
+	return ServerProtocol::encode_response(request.id, ServerProtocol::ok, body);
+}
@@ -0,0 +1,171 @@
+//
+//  server.hpp
+//  mstrie
+//
+//  Copyright © 2018 Mikita Akulich. All rights reserved.
+//
+
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <shared_mutex>
+#include <thread>
+#include "../core/index_manager.hpp"
+#include "../lib/configurator.hpp"
+
+
+/* Frames of the server protocol
+ *
+ * Every frame starts with its length in bytes, not counting the length
+ * itself. The integers are unsigned big-endian unless noted otherwise.
+ *
+ * request:  length:4 id:4 operation:1 query_type:1 limit:4 (signed, -1 - none) word
+ * response: length:4 id:4 status:1 body
+ *
+ * The operations are 1 - search, 2 - update and 3 - retrieve, the query
+ * types are 1 - '=', 2 - '<=', 3 - '>=', 4 - '+' and 5 - '-'. The word is
+ * a multiset in the notation of the CLI. The status is 0 on success, the
+ * body is then 1 byte 0 | 1 for a search, empty for an update and the
+ * found multisets separated by '|' for a retrieval. Otherwise the status
+ * is 1 and the body is the error message.
+ */
+class ServerProtocol {
+public:
+	enum Operation : uint8_t { search = 1, update = 2, retrieve = 3 };
+	enum Status : uint8_t { ok = 0, error = 1 };
+
+	// bytes before the word of a request frame, the length included
+	static const size_t request_header = 14;
+
+	static uint32_t read_u32(const char *data);
+	static void append_u32(std::string &frame, uint32_t value);
+	// query type of the manager for the code of a frame, empty if unknown
+	static std::string query_type(uint8_t code);
+	static std::string encode_response(uint32_t id, Status status, const std::string &body);
+};
+
+/* Request taken from a frame */
+class ServerRequest {
+public:
+	uint64_t connection;
+	// position of the request on its connection, the responses are sent in this order
+	uint64_t sequence;
+	uint32_t id;
+	uint8_t operation;
+	std::string query_type;
+	int limit;
+	std::string word;
+};
+
+/* Encoded response to a request */
+class ServerResponse {
+public:
+	uint64_t connection;
+	uint64_t sequence;
+	std::string frame;
+};
+
+/* Client connection, owned by the event loop thread */
+class ServerConnection {
+public:
+	int fd;
+	// bytes received and not decoded yet
+	std::string input;
+	// encoded responses not written yet, from output_offset
+	std::string output;
+	size_t output_offset;
+	// sequence of the next request and of the next response to be written
+	uint64_t next_request;
+	uint64_t next_response;
+	// responses that are done before the responses of earlier requests
+	std::map<uint64_t, std::string> done;
+	// the peer has closed its side, the connection is closed when the output is written
+	bool closing;
+	// events the connection is registered for in epoll
+	uint32_t events;
+
+	ServerConnection(int fd);
+	uint64_t in_flight() const;
+};
+
+/* Multiset-trie served over a TCP or a Unix domain socket
+ *
+ * One thread runs an epoll loop that accepts connections, decodes request
+ * frames and writes responses. The requests are executed by a pool of
+ * workers, which hand the encoded responses back to the loop through an
+ * eventfd. A client may send further requests before the responses
+ * arrive; the requests of a connection are executed one at a time in
+ * request order, so a query sees the updates sent before it, and the
+ * requests of different connections run on different workers. Updates
+ * take the manager exclusively; queries share it unless the Multiset-trie
+ * records the statistics of the last query.
+ */
+class Server {
+private:
+	std::unique_ptr<Configurator> config;
+	std::unique_ptr<MstrieManager> manager;
+	std::shared_timed_mutex manager_mutex;
+	// queries take manager_mutex shared, otherwise they are run one at a time
+	bool concurrent_queries;
+
+	// tcp:<host>:<port> | unix:<path>
+	std::string listen_address;
+	std::string unix_path;
+	uint workers;
+	// frames above are rejected and their connection is closed
+	size_t max_frame;
+	// requests of a connection in the workers, further frames are not read until some are done
+	size_t max_pipeline;
+
+	int epoll_fd;
+	int listen_fd;
+	// the workers signal done responses
+	int wake_fd;
+	// SIGINT and SIGTERM stop the server
+	int signal_fd;
+	std::map<uint64_t, ServerConnection> connections;
+	uint64_t next_connection;
+
+	// requests of every connection in request order, the first one is being executed or ready
+	std::map<uint64_t, std::deque<ServerRequest>> pending;
+	// connections whose first pending request is not taken by a worker yet
+	std::queue<uint64_t> ready;
+	std::mutex requests_mutex;
+	std::condition_variable requests_cv;
+	bool stopping;
+	std::vector<ServerResponse> responses;
+	std::mutex responses_mutex;
+	std::vector<std::thread> worker_threads;
+
+	void open_listener();
+	void accept_connections();
+	void read_connection(uint64_t id);
+	// decodes the complete frames in the input of the connection, false if the connection was closed
+	bool decode_requests(uint64_t id, ServerConnection &connection);
+	// moves the done responses that are next in request order to the output
+	void collect_responses(ServerConnection &connection);
+	void write_connection(uint64_t id);
+	void close_connection(uint64_t id);
+	// registers the connection for reading unless its pipeline is full, and for writing if output is pending
+	void update_events(uint64_t id, ServerConnection &connection);
+	void deliver_responses();
+
+	void work();
+	std::string execute(const ServerRequest &request);
+public:
+	Server(const Configurator &config);
+	~Server();
+	Server(const Server&) = delete;
+	Server& operator=(const Server&) = delete;
+
+	// serves until SIGINT or SIGTERM, then saves the Multiset-trie
+	void run();
+};
+
+#endif /* SERVER_HPP */
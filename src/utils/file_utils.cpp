@@ -9,6 +9,12 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <cerrno>
+#include <cstdio>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include "file_utils.hpp"
 
@@ -35,6 +41,56 @@ void FileUtils::write_file(const std::string &file_path, const std::string &cont
 
 // -----------------------------------------------------------------------------------------------
 
+void FileUtils::replace_file(const std::string &file_path, const std::string &content) {
+	/* Write content next to the target and swap it in, so that
+	 * the target holds either the old or the new content; the new
+	 * content persists once this returns, also after a power loss */
+	std::string tmp_path = file_path + ".tmp";
+	int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		throw std::runtime_error("ERROR: File "+tmp_path+" can't be opened.");
+	}
+	const char *data = content.data();
+	size_t left = content.size();
+	while (left > 0) {
+		ssize_t written = write(fd, data, left);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			close(fd);
+			throw std::runtime_error("ERROR: File "+tmp_path+" can't be written.");
+		}
+		data += written;
+		left -= written;
+	}
+	if (fsync(fd) != 0) {
+		close(fd);
+		throw std::runtime_error("ERROR: File "+tmp_path+" can't be synced.");
+	}
+	close(fd);
+	if (rename(tmp_path.c_str(), file_path.c_str()) != 0) {
+		throw std::runtime_error("ERROR: File "+file_path+" can't be replaced.");
+	}
+	sync_directory(file_path);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+void FileUtils::sync_directory(const std::string &file_path) {
+	auto slash = file_path.find_last_of('/');
+	std::string dir_path = slash == std::string::npos ? "." : file_path.substr(0, slash > 0 ? slash : 1);
+	int fd = open(dir_path.c_str(), O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		throw std::runtime_error("ERROR: Directory "+dir_path+" can't be opened.");
+	}
+	if (fsync(fd) != 0) {
+		close(fd);
+		throw std::runtime_error("ERROR: Directory "+dir_path+" can't be synced.");
+	}
+	close(fd);
+}
+
+// -----------------------------------------------------------------------------------------------
+
 std::string FileUtils::read_from_file(const std::string &file_path) {
 	std::ifstream ifile;
 	/* Setting exceptions for a file to be thrown */
@@ -77,3 +133,51 @@ bool FileUtils::check_file_extension(const std::string &file_path, const std::st
 	std::string file_extension = get_file_extension(file_path);
 	return (file_extension.compare(extension_to_check) == 0);
 }
+
+// -----------------------------------------------------------------------------------------------
+
+FileUtils::MappedFile::MappedFile(const std::string &file_path) {
+	int fd = open(file_path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("ERROR: File "+file_path+" can't be opened.");
+	}
+	struct stat buf;
+	if (fstat(fd, &buf) != 0) {
+		close(fd);
+		throw std::runtime_error("ERROR: File "+file_path+" can't be read.");
+	}
+	_size = buf.st_size;
+	_data = nullptr;
+	if (_size > 0) {
+		void *mapping = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("ERROR: File "+file_path+" can't be mapped.");
+		}
+		// the file is read once from the beginning to the end
+		madvise(mapping, _size, MADV_SEQUENTIAL);
+		madvise(mapping, _size, MADV_WILLNEED);
+		_data = static_cast<const char*>(mapping);
+	}
+	close(fd);
+}
+
+// -----------------------------------------------------------------------------------------------
+
+FileUtils::MappedFile::~MappedFile() {
+	if (_data != nullptr) {
+		munmap(const_cast<char*>(_data), _size);
+	}
+}
+
+// -----------------------------------------------------------------------------------------------
+
+const char* FileUtils::MappedFile::data() const {
+	return _data;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+size_t FileUtils::MappedFile::size() const {
+	return _size;
+}
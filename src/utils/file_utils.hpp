@@ -9,10 +9,31 @@
 #ifndef FILE_UTILS_HPP
 #define FILE_UTILS_HPP
 
+#include <string>
+
 class FileUtils {
 public:
+	/* Read-only memory mapping of a whole file */
+	class MappedFile {
+	private:
+		const char *_data;
+		size_t _size;
+	public:
+		MappedFile(const std::string &file_path);
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		
+		const char* data() const;
+		size_t size() const;
+	};
+	
+
 	static bool file_exists(const std::string &file_path);
 	static void write_file(const std::string &file_path, const std::string &content);
+	static void replace_file(const std::string &file_path, const std::string &content);
+	// syncs the directory of the file, so that its creation or renaming persists
+	static void sync_directory(const std::string &file_path);
 	static std::string read_from_file(const std::string &file_path);
 	static bool check_file_extension(const std::string &file_path, const std::string &extension_to_check);
 };